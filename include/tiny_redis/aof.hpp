@@ -4,6 +4,7 @@
 #include <atomic>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <thread>
 #include <mutex>
@@ -35,7 +36,7 @@ namespace tiny_redis {
         bool appendCommand(const std::vector<std::string> &parts);
 
         // @brief 往AOF记录原生的RESP协议命令
-        bool appendRaw(const std::string &raw_resp);
+        bool appendRaw(std::string_view raw_resp);
 
         bool isEnabled() const { return opts_.enabled; }
         AofMode mode() const { return opts_.mode; }
@@ -0,0 +1,66 @@
+/**
+ * @file tiny_redis/command.hpp
+ * @brief 命令表: 客户端请求与从节点应用主节点命令流共用同一套命令实现
+ */
+#ifndef __TINY_REDIS_COMMAND_HPP__
+#define __TINY_REDIS_COMMAND_HPP__
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "tiny_redis/resp.hpp"
+
+namespace tiny_redis {
+
+    // @brief 命令的属性
+    enum CommandFlags : uint32_t {
+        kCmdWrite = 1u << 0,    // 会修改数据集, 需要写AOF并传播给从节点
+        kCmdReadOnly = 1u << 1, // 只读取数据集
+        kCmdAdmin = 1u << 2,    // 管理类命令(SAVE, CONFIG, ...)
+    };
+
+    // @brief 执行一条命令时的上下文
+    struct CommandContext {
+        std::string_view raw;  // 命令的原始RESP字节, 非空时直接追加到AOF, 省去重新序列化
+        bool propagate = true; // 是否传播给从节点; 从节点应用主节点的命令流时为false
+    };
+
+    using CommandProc = std::string (*)(const RespValue &v, CommandContext &ctx);
+
+    struct Command {
+        const char *name = "";
+        CommandProc proc = nullptr;
+        int arity = 0;      // 与Redis一致: 正数表示参数个数(包括命令名)固定, 负数表示至少-arity个
+        uint32_t flags = 0;
+    };
+
+    /**
+     * @brief 命令名(大写)到命令实现的映射
+     * @note 启动时注册完所有命令, 之后只读, 因此可以被事件循环和复制线程同时查找
+     */
+    class CommandTable {
+    public:
+        void add(const Command &cmd);
+
+        // @brief 大小写不敏感地查找命令, 不存在时返回nullptr
+        const Command *lookup(std::string_view name) const;
+
+    private:
+        std::unordered_map<std::string, Command> cmds_;
+    };
+
+    extern CommandTable g_commands;
+
+    /**
+     * @brief 查表执行一条命令: 校验参数个数后调用命令实现
+     * @param v 客户端发来的命令数组
+     * @param ctx 执行上下文
+     * @return 序列化好的RESP回复
+     */
+    std::string dispatchCommand(const RespValue &v, CommandContext &ctx);
+
+}   // namespace tiny_redis
+
+#endif
@@ -42,6 +42,20 @@ namespace tiny_redis {
         uint16_t master_port = 0;
     };
 
+    // @brief 主节点侧的复制配置
+    struct ReplicationOptions
+    {
+        size_t backlog_size = 64 * 1024 * 1024; // repl-backlog-size, 复制积压缓冲区大小
+        bool diskless_sync = false;             // repl-diskless-sync, 全量同步时不落盘, 直接把快照写到从节点的socket
+    };
+
+    struct DefragOptions
+    {
+        bool enabled = false;       // activedefrag, 是否开启主动碎片整理
+        int cycle_us = 1000;        // 每次定时器tick允许占用的CPU时间(us)
+        int threshold_pct = 10;     // 堆内空闲字节占已用字节的百分比超过该值才开始整理
+    };
+
     struct ServerConfig
     {
         uint16_t port = 6379;
@@ -49,6 +63,8 @@ namespace tiny_redis {
         AofOptions aof;
         RdbOptions rdb;
         ReplicaOptions replica;
+        ReplicationOptions repl;
+        DefragOptions defrag;
     };
 
 } // namespace tiny_redis
@@ -0,0 +1,38 @@
+/**
+ * @file tiny_redis/defrag.hpp
+ * @brief 主动碎片整理(activedefrag)使用的公共判断与游标
+ */
+#ifndef __TINY_REDIS_DEFRAG_HPP__
+#define __TINY_REDIS_DEFRAG_HPP__
+
+#include <cstddef>
+#include <string>
+
+namespace tiny_redis {
+
+    /**
+     * @brief 判断一个字符串是否值得重新分配(碎片整理)
+     * @note 容量超过SSO且浪费的空间超过实际长度的一半时, 拷贝一份紧凑的副本可以归还多余的内存
+     */
+    inline bool shouldRelocate(const std::string &s)
+    {
+        return s.capacity() > 32 && s.capacity() - s.size() > s.size() / 2;
+    }
+
+    /**
+     * @brief 单个集合内部的碎片整理游标, 大集合分多次整理时记录下一次开始的位置
+     * @note 两次整理之间集合可能被修改, 下标类游标只保证不越界, 允许少量元素被重复检查或漏过本轮
+     */
+    struct DefragCursor
+    {
+        bool active = false; // true: 上次没有整理完, 下次从该位置继续
+        size_t pos = 0;      // 按下标遍历时使用: 桶下标/数组下标/quicklist节点下标
+        double score = 0;    // 跳表使用: 下一个待检查的节点
+        std::string member;
+
+        void reset() { *this = DefragCursor(); }
+    };
+
+} // namespace tiny_redis
+
+#endif
@@ -0,0 +1,377 @@
+/**
+ * @file tiny_redis/dict.hpp
+ * @brief 桶数组大小为2的幂的链式哈希表, 用于需要SCAN的键空间以及Hash/ZSet的成员字典
+ */
+#ifndef __TINY_REDIS_DICT_HPP__
+#define __TINY_REDIS_DICT_HPP__
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace tiny_redis {
+
+    /**
+     * @brief 接口是std::unordered_map的一个子集, 区别在于桶数组大小始终为2的幂, 元素所在的桶就是哈希值的低位
+     * @note 扩容时一个旧桶里的元素只会分散到低位与之相同的几个新桶, 缩容时只会合并到同一个新桶,
+     * 因此SCAN可以使用反向二进制游标, 两次调用之间发生rehash也不会漏掉元素或从头遍历.
+     * libstdc++的unordered_map桶数组大小为素数, rehash后元素的桶下标被完全打乱, 做不到这一点.
+     * 与unordered_map相同, rehash会使迭代器失效, 但元素的引用和指针保持有效.
+     * 扩容与rehash仍然是一次性搬迁所有节点(与unordered_map相同), 不做Redis那样的渐进式rehash,
+     * 键空间很大时插入触发的扩容依旧会有一次停顿
+     */
+    template <typename K, typename V, typename Hash = std::hash<K>>
+    class Dict
+    {
+        struct Node
+        {
+            template <typename KK, typename... Args>
+            Node(size_t h, KK &&k, Args &&...args)
+                : kv(std::piecewise_construct, std::forward_as_tuple(std::forward<KK>(k)),
+                     std::forward_as_tuple(std::forward<Args>(args)...)),
+                  hash(h)
+            {
+            }
+            std::pair<const K, V> kv;
+            size_t hash;
+            Node *next = nullptr;
+        };
+
+    public:
+        using key_type = K;
+        using mapped_type = V;
+        using value_type = std::pair<const K, V>;
+        using size_type = size_t;
+
+        // @brief 全表迭代器, 按桶下标从小到大访问
+        template <bool Const>
+        class Iter
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::pair<const K, V>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = std::conditional_t<Const, const value_type *, value_type *>;
+            using reference = std::conditional_t<Const, const value_type &, value_type &>;
+
+            Iter() = default;
+            // 允许iterator隐式转换为const_iterator
+            template <bool C = Const, typename = std::enable_if_t<C>>
+            Iter(const Iter<false> &o) : d_(o.d_), b_(o.b_), n_(o.n_) {}
+
+            reference operator*() const { return n_->kv; }
+            pointer operator->() const { return &n_->kv; }
+            Iter &operator++()
+            {
+                n_ = n_->next;
+                if (n_ == nullptr)
+                {
+                    const size_t from = b_ + 1;
+                    n_ = d_->firstFrom(from, b_);
+                }
+                return *this;
+            }
+            Iter operator++(int)
+            {
+                Iter t = *this;
+                ++*this;
+                return t;
+            }
+            bool operator==(const Iter &o) const { return n_ == o.n_; }
+            bool operator!=(const Iter &o) const { return n_ != o.n_; }
+
+        private:
+            friend class Dict;
+            template <bool>
+            friend class Iter;
+            Iter(const Dict *d, size_t b, Node *n) : d_(d), b_(b), n_(n) {}
+            const Dict *d_ = nullptr;
+            size_t b_ = 0;
+            Node *n_ = nullptr;
+        };
+
+        // @brief 单个桶内的迭代器
+        template <bool Const>
+        class LocalIter
+        {
+        public:
+            using pointer = std::conditional_t<Const, const value_type *, value_type *>;
+            using reference = std::conditional_t<Const, const value_type &, value_type &>;
+
+            reference operator*() const { return n_->kv; }
+            pointer operator->() const { return &n_->kv; }
+            LocalIter &operator++()
+            {
+                n_ = n_->next;
+                return *this;
+            }
+            bool operator==(const LocalIter &o) const { return n_ == o.n_; }
+            bool operator!=(const LocalIter &o) const { return n_ != o.n_; }
+
+        private:
+            friend class Dict;
+            explicit LocalIter(Node *n) : n_(n) {}
+            Node *n_ = nullptr;
+        };
+
+        using iterator = Iter<false>;
+        using const_iterator = Iter<true>;
+        using local_iterator = LocalIter<false>;
+        using const_local_iterator = LocalIter<true>;
+
+        // @brief extract取出的节点, 析构时释放
+        class node_type
+        {
+        public:
+            const K &key() const { return n_->kv.first; }
+            V &mapped() { return n_->kv.second; }
+            bool empty() const { return !n_; }
+
+        private:
+            friend class Dict;
+            explicit node_type(Node *n) : n_(n) {}
+            std::unique_ptr<Node> n_;
+        };
+
+        Dict() = default;
+        ~Dict() { destroyNodes(); }
+
+        Dict(const Dict &o) : max_load_(o.max_load_)
+        {
+            buckets_.assign(o.buckets_.size(), nullptr);
+            first_ = buckets_.size();
+            for (const Node *b : o.buckets_)
+            {
+                for (const Node *n = b; n != nullptr; n = n->next)
+                    link(new Node(n->hash, n->kv.first, n->kv.second));
+            }
+        }
+
+        Dict(Dict &&o) noexcept { swap(o); }
+
+        Dict &operator=(Dict o) noexcept
+        {
+            swap(o);
+            return *this;
+        }
+
+        void swap(Dict &o) noexcept
+        {
+            buckets_.swap(o.buckets_);
+            std::swap(size_, o.size_);
+            std::swap(first_, o.first_);
+            std::swap(max_load_, o.max_load_);
+        }
+
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        size_t bucket_count() const { return buckets_.size(); }
+        float max_load_factor() const { return max_load_; }
+        float load_factor() const { return buckets_.empty() ? 0.0f : static_cast<float>(size_) / static_cast<float>(buckets_.size()); }
+
+        iterator begin()
+        {
+            size_t b = 0;
+            Node *n = firstFrom(first_, b);
+            first_ = b;
+            return iterator(this, b, n);
+        }
+        iterator end() { return iterator(this, buckets_.size(), nullptr); }
+        const_iterator begin() const
+        {
+            size_t b = 0;
+            Node *n = firstFrom(first_, b);
+            first_ = b;
+            return const_iterator(this, b, n);
+        }
+        const_iterator end() const { return const_iterator(this, buckets_.size(), nullptr); }
+
+        local_iterator begin(size_t b) { return local_iterator(buckets_[b]); }
+        local_iterator end(size_t) { return local_iterator(nullptr); }
+        const_local_iterator begin(size_t b) const { return const_local_iterator(buckets_[b]); }
+        const_local_iterator end(size_t) const { return const_local_iterator(nullptr); }
+
+        iterator find(const K &k)
+        {
+            const size_t h = Hash{}(k);
+            return iterator(this, bucketOf(h), findNode(k, h));
+        }
+        const_iterator find(const K &k) const
+        {
+            const size_t h = Hash{}(k);
+            return const_iterator(this, bucketOf(h), findNode(k, h));
+        }
+        size_t count(const K &k) const { return findNode(k) != nullptr ? 1 : 0; }
+
+        // @brief key不存在时用args构造value插入, 已存在时什么都不做
+        template <typename KK, typename... Args>
+        std::pair<iterator, bool> emplace(KK &&k, Args &&...args)
+        {
+            const size_t h = Hash{}(k);
+            if (Node *n = findNode(k, h))
+                return {iterator(this, bucketOf(h), n), false};
+            growForInsert();
+            Node *n = new Node(h, std::forward<KK>(k), std::forward<Args>(args)...);
+            link(n);
+            return {iterator(this, bucketOf(h), n), true};
+        }
+
+        V &operator[](const K &k) { return emplace(k).first->second; }
+        V &operator[](K &&k) { return emplace(std::move(k)).first->second; }
+
+        // @brief 删除it指向的元素, 返回下一个元素
+        iterator erase(const_iterator it)
+        {
+            iterator next(this, it.b_, it.n_);
+            ++next;
+            delete unlink(it.b_, it.n_);
+            return next;
+        }
+        iterator erase(iterator it) { return erase(const_iterator(it)); }
+
+        size_t erase(const K &k)
+        {
+            const size_t h = Hash{}(k);
+            Node *n = findNode(k, h);
+            if (n == nullptr)
+                return 0;
+            delete unlink(bucketOf(h), n);
+            return 1;
+        }
+
+        node_type extract(const_iterator it) { return node_type(unlink(it.b_, it.n_)); }
+
+        // @brief 删除所有元素, 桶数组保持原大小
+        void clear()
+        {
+            destroyNodes();
+            std::fill(buckets_.begin(), buckets_.end(), nullptr);
+            size_ = 0;
+            first_ = buckets_.size();
+        }
+
+        /**
+         * @brief 把桶数组调整为不小于n且能容纳当前元素的最小的2的幂, rehash(0)即收缩到刚好够用
+         */
+        void rehash(size_t n)
+        {
+            const size_t need = static_cast<size_t>(std::ceil(static_cast<float>(size_) / max_load_));
+            const size_t nb = roundUp(std::max(n, need));
+            if (nb == buckets_.size())
+                return;
+            std::vector<Node *> old(nb, nullptr);
+            old.swap(buckets_);
+            size_ = 0;
+            first_ = buckets_.size();
+            for (Node *b : old)
+            {
+                while (b != nullptr)
+                {
+                    Node *next = b->next;
+                    link(b);
+                    b = next;
+                }
+            }
+        }
+
+        void reserve(size_t n) { rehash(static_cast<size_t>(static_cast<float>(n) / max_load_) + 1); }
+
+    private:
+        static size_t roundUp(size_t n)
+        {
+            size_t nb = 1;
+            while (nb < n)
+                nb <<= 1;
+            return nb;
+        }
+
+        size_t bucketOf(size_t h) const { return h & (buckets_.size() - 1); }
+
+        Node *findNode(const K &k) const { return findNode(k, Hash{}(k)); }
+        Node *findNode(const K &k, size_t h) const
+        {
+            if (size_ == 0)
+                return nullptr;
+            for (Node *n = buckets_[bucketOf(h)]; n != nullptr; n = n->next)
+            {
+                if (n->hash == h && n->kv.first == k)
+                    return n;
+            }
+            return nullptr;
+        }
+
+        // @brief 从桶b开始找第一个非空的桶, 找到时写入out并返回其首个节点
+        Node *firstFrom(size_t b, size_t &out) const
+        {
+            for (; b < buckets_.size(); ++b)
+            {
+                if (buckets_[b] != nullptr)
+                {
+                    out = b;
+                    return buckets_[b];
+                }
+            }
+            out = buckets_.size();
+            return nullptr;
+        }
+
+        void growForInsert()
+        {
+            if (buckets_.empty())
+                rehash(4);
+            else if (static_cast<float>(size_ + 1) > max_load_ * static_cast<float>(buckets_.size()))
+                rehash(buckets_.size() * 2);
+        }
+
+        void link(Node *n)
+        {
+            const size_t b = bucketOf(n->hash);
+            n->next = buckets_[b];
+            buckets_[b] = n;
+            if (b < first_)
+                first_ = b;
+            ++size_;
+        }
+
+        Node *unlink(size_t b, Node *n)
+        {
+            Node **p = &buckets_[b];
+            while (*p != n)
+                p = &(*p)->next;
+            *p = n->next;
+            n->next = nullptr;
+            --size_;
+            return n;
+        }
+
+        void destroyNodes()
+        {
+            for (Node *b : buckets_)
+            {
+                while (b != nullptr)
+                {
+                    Node *next = b->next;
+                    delete b;
+                    b = next;
+                }
+            }
+        }
+
+        std::vector<Node *> buckets_;
+        size_t size_ = 0;
+        // 第一个非空桶下标的下界, 避免从头部反复删除元素时每次begin()都从0号桶开始找
+        mutable size_t first_ = 0;
+        float max_load_ = 1.0f;
+    };
+
+} // namespace tiny_redis
+
+#endif
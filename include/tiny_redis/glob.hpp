@@ -0,0 +1,65 @@
+/**
+ * @file tiny_redis/glob.hpp
+ * @brief Redis兼容的glob模式匹配(KEYS, SCAN MATCH, CONFIG GET共用)
+ */
+#ifndef __TINY_REDIS_GLOB_HPP__
+#define __TINY_REDIS_GLOB_HPP__
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tiny_redis {
+
+    /**
+     * @brief 预编译的glob模式, 每次命令调用只编译一次, 之后对每个候选字符串调用match
+     * @note 支持`*`, `?`, `[abc]`, `[^a-z]`以及`\`转义;
+     * 模式开头的字面量前缀单独保存, 先用memcmp快速过滤, 剩余部分编译为一个小型NFA逐字符模拟
+     */
+    class GlobMatcher {
+    public:
+        explicit GlobMatcher(std::string_view pattern);
+
+        // @brief 判断字符串是否匹配该模式
+        bool match(std::string_view s) const;
+
+        // @brief 模式开头不含通配符的部分
+        const std::string &literalPrefix() const { return prefix_; }
+
+        // @brief 模式不含任何通配符, 此时只有与前缀完全相等的字符串才能匹配
+        bool isLiteral() const { return ops_.empty(); }
+
+        // @brief 模式能匹配任意字符串(例如`*`)
+        bool matchesAll() const { return prefix_.empty() && all_star_; }
+
+    private:
+        enum class OpType : uint8_t {
+            kChar,  // 匹配一个指定字符
+            kAny,   // `?`, 匹配任意一个字符
+            kStar,  // `*`, 匹配任意个字符
+            kClass, // `[...]`, 匹配字符集合中的一个字符
+        };
+
+        struct Op {
+            OpType type = OpType::kChar;
+            char ch = 0;
+            std::array<uint64_t, 4> set{}; // kClass使用的256位字符集合
+        };
+
+        // @brief 判断第i个操作能否消耗字符c
+        bool accepts(const Op &op, unsigned char c) const;
+
+        std::string prefix_;   // 字面量前缀
+        std::vector<Op> ops_;  // 前缀之后的部分编译出的操作序列, NFA的状态i表示已经匹配完前i个操作
+        bool all_star_ = true; // ops_是否全部为`*`
+
+        // 操作个数小于64时使用位并行模拟: 第i位表示状态i是否活跃
+        uint64_t star_mask_ = 0;          // 哪些状态上是`*`
+        std::vector<uint64_t> accept_;    // accept_[c]: 哪些非`*`状态可以消耗字符c
+    };
+
+} // namespace tiny_redis
+
+#endif
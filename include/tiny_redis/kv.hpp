@@ -13,8 +13,14 @@
 #include <optional>
 #include <thread>
 #include <mutex>
+#include <chrono>
+#include <functional>
 #include <stdlib.h>
+#include <sys/types.h>
+#include "tiny_redis/defrag.hpp"
+#include "tiny_redis/dict.hpp"
 #include "tiny_redis/skiplist.hpp"
+#include "tiny_redis/glob.hpp"
 
 namespace tiny_redis {
 
@@ -24,7 +30,7 @@ namespace tiny_redis {
     };
 
     struct HashRecord {
-        std::unordered_map<std::string, std::string> fields;
+        Dict<std::string, std::string> fields;
         int64_t expire_at_ms = -1;
     };
 
@@ -33,7 +39,7 @@ namespace tiny_redis {
         bool use_skiplist = false;
         std::vector<std::pair<double, std::string>> items; // 当use_skiplist=false
         std::unique_ptr<Skiplist> sl; // 当use_skiplist=true
-        std::unordered_map<std::string, double> member_to_score;
+        Dict<std::string, double> member_to_score;
         int64_t expire_at_ms = -1;
     };
 
@@ -93,14 +99,88 @@ namespace tiny_redis {
          */
         int expireScanStep(int max_steps);
 
+        /**
+         * @brief 主动碎片整理(activedefrag), 在时间预算内增量地遍历键空间,
+         * 把浪费空间过多的value/field/成员重新分配到紧凑的内存上
+         * @param budget_us 本次整理允许占用的CPU时间, 以us为单位
+         * @return 本次被重新分配的对象个数
+         * @note 以桶下标作为游标, 大的集合按片整理并在片与片之间检查时间, 超时后下次从集合内部的游标继续;
+         * 一次完整的遍历结束后逐个收缩顶层哈希表, 并把空闲页归还给操作系统(至多每10秒一次).
+         * 所有rehash都先按桶数与节点数估计代价, 剩余预算不够时跳过, 留到之后预算充足的时候
+         */
+        int defragStep(int64_t budget_us);
+
+        // @brief 碎片整理统计: hits为被重新分配的对象数, misses为检查后无需整理的对象数
+        int64_t defragHits() const;
+        int64_t defragMisses() const;
+
         // @brief 快照
         std::vector<std::pair<std::string, ValueRecord>> snapshot() const;
         std::vector<std::pair<std::string, HashRecord>> snapshotHash() const;
 
         std::vector<ZSetFlat> snapshotZSet() const;
 
-        // @brief 获取所有的key, 保存到数组中返回
-        std::vector<std::string> listKeys() const;
+        /**
+         * @brief fork出一个子进程用于序列化数据集, 返回值同fork(): 父进程得到子进程pid, 子进程得到0, 失败返回-1
+         * @note fork时持有mu_, 子进程看到的是fork那一刻的完整数据集, 与父进程写时复制共享内存, 不需要拷贝;
+         * 子进程中只应调用visit*系列函数并以_exit结束, 不能使用日志等依赖其他线程的组件
+         */
+        pid_t forkSnapshot() const;
+
+        // @brief Hash, ZSet类型的key个数(含已过期但尚未删除的), 用于写出快照中各段的记录数
+        size_t hashSize() const { return hmap_.size(); }
+        size_t zsetSize() const { return zmap_.size(); }
+
+        /**
+         * @brief 在一次加锁内依次访问所有记录, 包括已过期但尚未删除的记录(由加载方跳过)
+         * @param fn 回调, 返回false时停止遍历; 回调内不能再调用KeyValueStore的接口
+         * @return 访问完所有记录返回true, 被回调中止返回false
+         * @note 遍历期间一直持有锁, 只应在forkSnapshot的子进程中调用
+         */
+        bool visitStrings(const std::function<bool(const std::string &, const ValueRecord &)> &fn) const;
+        bool visitHashes(const std::function<bool(const std::string &, const HashRecord &)> &fn) const;
+        bool visitZSets(const std::function<bool(const std::string &, const ZSetRecord &)> &fn) const;
+
+        // @brief 清空所有数据
+        void clear();
+
+        /**
+         * @brief 在一次加锁内执行fn, fn内对store的调用只是重入计数, 不会再去竞争锁
+         * @note 从节点批量应用主节点的命令流时使用, 避免每条命令都单独加锁解锁
+         */
+        template <typename Fn>
+        void withLock(Fn &&fn)
+        {
+            std::lock_guard<std::recursive_mutex> lk(mu_);
+            fn();
+        }
+
+        // @brief 时间戳函数, 精度到ms级别, 与过期时间使用同一个时钟
+        static int64_t nowMs();
+
+        /**
+         * @brief 获取所有匹配模式的key, 保存到数组中返回
+         * @note 同一个key可能同时存在于多个表中, 只在第一次出现时返回; 已过期的key不返回
+         */
+        std::vector<std::string> listKeys(const GlobMatcher &pattern) const;
+
+        /**
+         * @brief 基于游标的增量遍历键空间(SCAN)
+         * @param cursor 上一次调用返回的游标, 0表示从头开始
+         * @param count 本次最多访问的非空桶个数, 用于限制单次调用的工作量
+         * @param type 只遍历指定类型("string", "hash", "zset")的key, 为空表示不过滤
+         * @param out 本次遍历到的key追加到该数组
+         * @return 下一次调用使用的游标, 返回0表示遍历结束
+         * @note 每个表使用反向二进制游标(同Redis): 在整个遍历期间都存在的key至少返回一次, 表扩容不会产生重复,
+         * 只有表在两次调用之间缩容时才可能重复返回. 同时存在于多个表中的key只在第一个表中返回(同listKeys)
+         */
+        uint64_t scan(uint64_t cursor, size_t count, const std::string &type, std::vector<std::string> &out) const;
+
+        // @brief 增量遍历Hash中的字段, out中依次保存field, value
+        uint64_t hscan(const std::string &key, uint64_t cursor, size_t count, std::vector<std::string> &out);
+
+        // @brief 增量遍历ZSet中的成员, out中保存(member, score)
+        uint64_t zscan(const std::string &key, uint64_t cursor, size_t count, std::vector<std::pair<std::string, double>> &out);
 
         // Hash APIs
         int hset(const std::string &key, const std::string &field, const std::string &value);
@@ -126,17 +206,33 @@ namespace tiny_redis {
         bool setZSetExpireAtMs(const std::string &key, int64_t expire_at_ms);
 
     private:
-        std::unordered_map<std::string, ValueRecord> map_;
-        std::unordered_map<std::string, ValueRecord>::iterator scan_it_ = map_.end();
-        std::unordered_map<std::string, HashRecord> hmap_;
-        std::unordered_map<std::string, HashRecord>::iterator hscan_it_ = hmap_.end();
-        std::unordered_map<std::string, ZSetRecord> zmap_;
-        std::unordered_map<std::string, ZSetRecord>::iterator zscan_it_ = zmap_.end();
+        // 顶层的表以及Hash/ZSet的成员字典使用桶数组为2的幂的Dict, 见dict.hpp
+        Dict<std::string, ValueRecord> map_;
+        Dict<std::string, HashRecord> hmap_;
+        Dict<std::string, ZSetRecord> zmap_;
         std::unordered_map<std::string, int64_t> expire_index_;
-        mutable std::mutex mu_;
+        mutable std::recursive_mutex mu_; // 可重入, 以便withLock内继续调用其他接口
+
+        // 碎片整理游标: 当前遍历的表(0: map_, 1: hmap_, 2: zmap_)以及桶下标;
+        // defrag_table_为3时处于一轮遍历之后的收尾阶段, defrag_bucket_为下一个待收缩的表
+        size_t defrag_table_ = 0;
+        size_t defrag_bucket_ = 0;
+        // 上次没有整理完的集合所在的key以及集合内部的游标
+        std::string defrag_key_;
+        DefragCursor defrag_cursor_;
+        int64_t defrag_last_trim_ms_ = 0; // 上次调用malloc_trim的时间
+        int64_t defrag_hits_ = 0;
+        int64_t defrag_misses_ = 0;
 
-        // @brief 时间戳函数, 精度到ms级别
-        static int64_t nowMs();
+        /**
+         * @brief 对单个桶内的所有对象做碎片整理, 被重新分配的对象个数累加到relocated
+         * @return 桶内某个集合到截止时间仍没有整理完时返回false, 下次从该集合的游标处继续
+         */
+        bool defragBucket(size_t table, size_t bucket, std::chrono::steady_clock::time_point deadline, int &relocated);
+        // @brief 收尾阶段: 负载过低且剩余预算来得及时收缩第idx个顶层哈希表(3为expire_index_)
+        void defragShrinkTable(size_t idx, std::chrono::steady_clock::time_point deadline);
+        // @brief 如有必要重新分配字符串, 并更新hits/misses统计
+        bool defragString(std::string &s);
 
         // @brief 判断field-value pairs是否过期的系列函数
         static bool isExpired(const ValueRecord &r, int64_t now_ms);
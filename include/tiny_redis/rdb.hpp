@@ -1,13 +1,18 @@
 #ifndef __TINY_REDIS_RDB_HPP__
 #define __TINY_REDIS_RDB_HPP__
 
+#include <functional>
 #include <string>
+#include <cstdint>
 #include "tiny_redis/config.hpp"
 
 namespace tiny_redis {
 
     class KeyValueStore;
 
+    // @brief 快照数据的输出端, 返回false表示写入失败, 序列化随之终止
+    using RdbSink = std::function<bool(const char *data, size_t len)>;
+
     class Rdb {
     public:
         Rdb() = default;
@@ -21,6 +26,7 @@ namespace tiny_redis {
          * @param store kv存储数据库
          * @param err 错误信息, 如果保存错误则将信息写入到err返回
          * @return 写入成功返回true, 失败返回false
+         * @note 由fork出的子进程写临时文件, 调用方等待子进程结束后再rename覆盖原文件
          */
         bool save(const KeyValueStore &store, std::string &err) const;
 
@@ -35,11 +41,66 @@ namespace tiny_redis {
         // @brief 返回RDB文件保存的路径
         std::string path() const;
 
+        /**
+         * @brief 将数据集以RDB格式分块写入sink, 内存中只保留一个待写出的数据块
+         * @param store kv存储数据库
+         * @param sink 数据块的输出端(文件或从节点的socket)
+         * @param err 错误信息
+         * @return 写入成功返回true, 否则返回false
+         * @note 写出期间一直持有store的锁, 因此只在KeyValueStore::forkSnapshot的子进程中调用,
+         * 子进程中的数据集就是fork那一刻的快照; 之后的写命令由调用方(复制流)从对应的偏移量开始补发
+         */
+        static bool writeSnapshot(const KeyValueStore &store, const RdbSink &sink, std::string &err);
+
     private:
         // RDB配置信息
         RdbOptions opts_{};
     };
 
+    /**
+     * @brief 增量解析RDB数据流, 数据可以按任意大小分块输入, 每解析出一条完整的记录就写入store
+     * @note 按长度前缀解析key和value, 因此value中包含换行符也能正确处理;
+     * 已经过期的记录(包括writeSnapshot写出的空记录)会被直接跳过
+     */
+    class RdbStreamLoader {
+    public:
+        explicit RdbStreamLoader(KeyValueStore &store) : store_(store) {}
+
+        // @brief 输入一块数据, 格式错误时返回false
+        bool feed(const char *data, size_t len, std::string &err);
+
+        // @brief 所有段都已经解析完毕
+        bool done() const { return state_ == State::kDone; }
+
+    private:
+        enum class State {
+            kMagic,
+            kStrCount,
+            kStr,
+            kHashCount,
+            kHashHead,
+            kHashField,
+            kZSetCount,
+            kZSetHead,
+            kZSetItem,
+            kDone,
+        };
+
+        // @brief 尝试解析一条记录, 数据不完整返回0, 格式错误返回-1, 成功返回1
+        int parseOne(std::string &err);
+
+        KeyValueStore &store_;
+        State state_ = State::kMagic;
+        std::string buf_;
+        size_t pos_ = 0;
+        bool v1_ = false;        // MRDB1格式只有字符串段
+        int64_t remaining_ = 0;  // 当前段剩余的记录数
+        int64_t field_left_ = 0; // 当前Hash/ZSet剩余的字段数
+        std::string cur_key_;    // 当前正在解析的Hash/ZSet的key
+        int64_t cur_expire_ = -1;
+        bool cur_skip_ = false;  // 当前Hash/ZSet已经过期, 跳过其所有字段
+    };
+
 }   // namespace tiny_redis
 
 #endif
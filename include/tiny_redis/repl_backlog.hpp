@@ -0,0 +1,66 @@
+/**
+ * @file tiny_redis/repl_backlog.hpp
+ * @brief 主节点的复制积压缓冲区(replication backlog)
+ */
+#ifndef __TINY_REDIS_REPL_BACKLOG_HPP__
+#define __TINY_REDIS_REPL_BACKLOG_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sys/uio.h>
+
+namespace tiny_redis {
+
+    /**
+     * @brief 固定容量的环形复制积压缓冲区
+     * @note 追加的代价只与写入的字节数有关, 写满后直接覆盖最旧的数据, 不需要移动已有数据;
+     * 偏移量与主节点的master_repl_offset一致, 即从复制开始以来命令流的总字节数
+     */
+    class ReplBacklog {
+    public:
+        ReplBacklog() = default;
+
+        /**
+         * @brief 创建(或重建)缓冲区
+         * @param capacity 缓冲区容量(字节)
+         * @param offset 当前的复制偏移量, 此后追加的第一个字节对应该偏移量
+         * @note 内存只在第一个从节点连接时才分配, 单机运行的主节点不占用这部分内存
+         */
+        void create(size_t capacity, int64_t offset);
+
+        bool active() const { return buf_ != nullptr; }
+
+        // @brief 追加命令流数据, 超出容量时覆盖最旧的数据
+        void append(const char *data, size_t len);
+
+        // @brief 缓冲区中第一个字节的偏移量
+        int64_t startOffset() const { return end_offset_ - static_cast<int64_t>(len_); }
+        // @brief 缓冲区中最后一个字节之后的偏移量
+        int64_t endOffset() const { return end_offset_; }
+
+        // @brief 从offset开始的数据是否仍然保存在缓冲区中(offset等于endOffset时表示没有需要补发的数据)
+        bool contains(int64_t offset) const;
+
+        /**
+         * @brief 获取从offset开始到末尾的数据, 不拷贝, 直接指向环形缓冲区内部
+         * @param iov 输出的分段, 发生回绕时最多两段
+         * @return 分段个数
+         * @note 返回的指针在下一次append之前有效
+         */
+        int segments(int64_t offset, struct iovec iov[2]) const;
+
+        size_t capacity() const { return cap_; }
+        size_t size() const { return len_; }
+
+    private:
+        std::unique_ptr<char[]> buf_; // 不使用vector, 避免初始化时就把整块内存写一遍
+        size_t cap_ = 0;
+        size_t head_ = 0; // 下一次写入的位置
+        size_t len_ = 0;  // 有效数据的长度
+        int64_t end_offset_ = 0;
+    };
+
+} // namespace tiny_redis
+
+#endif
@@ -6,10 +6,14 @@
 #ifndef __TINY_REDIS_REPLICA_CLIENT_HPP__
 #define __TINY_REDIS_REPLICA_CLIENT_HPP__
 
+#include <atomic>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <vector>
 
 #include "tiny_redis/config.hpp"
+#include "tiny_redis/resp.hpp"
 
 namespace tiny_redis {
 
@@ -21,12 +25,42 @@ namespace tiny_redis {
         void stop();
 
     private:
+        static constexpr int kMinBackoffMs = 100;  // 重连的初始间隔
+        static constexpr int kMaxBackoffMs = 5000; // 重连间隔的上限
+
+        // @brief 复制线程: 连接主节点并同步, 断开后按指数退避重连
         void threadMain();
 
+        // @brief 连接主节点, 返回非阻塞的socket, 失败返回-1
+        int connectMaster();
+
+        /**
+         * @brief 在一条连接上完成PSYNC握手, 然后持续应用主节点的命令流直到连接断开
+         * @return 是否完成了握手(用于重置重连间隔)
+         */
+        bool syncWithMaster(int fd);
+
+        /**
+         * @brief 从非阻塞socket读取数据, 期间定期检查running_以便stop()能及时返回
+         * @return 读到的字节数; 0表示超时, -1表示连接已断开
+         */
+        ssize_t readSome(int fd, char *buf, size_t cap);
+
+        /**
+         * @brief 解析并应用缓冲区中所有完整的命令, 每批命令只加一次store锁
+         * @return 遇到协议错误时返回false
+         */
+        bool applyStream(RespParser &parser);
+
+        // @brief 通过命令表应用一条主节点传来的写命令
+        void applyCommand(const std::vector<std::string_view> &argv, std::string_view raw);
+
         const ServerConfig &cfg_;
         std::thread th_;
-        bool running_ = false;
-        int64_t last_offset_ = 0;       // 从节点维护的复制偏移量
+        std::atomic<bool> running_{false};
+        std::string master_replid_;     // 主节点的复制ID, 为空表示还没有完成过全量同步
+        int64_t last_offset_ = 0;       // 从节点维护的复制偏移量: 已应用的命令流的字节数
+        RespValue scratch_;             // 复用的命令对象, 避免每条命令都重新分配参数字符串
     };
 
 }   // namespace tiny_redis
@@ -36,8 +36,21 @@ public:
     void append(std::string_view data);
     std::optional<RespValue> tryParseOne();
     std::optional<std::pair<RespValue, std::string>> tryParseOneWithRaw();
+
+    /**
+     * @brief 零拷贝地解析一条命令, 不构造RespValue
+     * @param argv 数组命令的各个参数; 顶层为简单字符串/错误/整数时只有一个元素, 即该行的内容
+     * @param raw 这条命令的原始字节, 第一个字节即顶层类型前缀
+     * @return 1表示成功, 0表示数据不完整, -1表示协议错误
+     * @note argv与raw都指向解析器内部的缓冲区, 在下一次append之前有效
+     */
+    int parseCommand(std::vector<std::string_view> &argv, std::string_view &raw);
+
+    // @brief 尚未解析的字节数
+    size_t pending() const { return buffer_.size() - consumed_; }
 private:
     std::string buffer_;
+    size_t consumed_ = 0; // 已解析的前缀长度, 到下一次append时才统一从缓冲区中移除
 
     bool parseLine(size_t &pos, std::string &out_line);
 
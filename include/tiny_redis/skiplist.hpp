@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <stdlib.h>
+#include "tiny_redis/defrag.hpp"
 
 namespace tiny_redis {
 
@@ -59,6 +60,16 @@ public:
 
     size_t size() const { return length_; }
 
+    /**
+     * @brief 碎片整理: 将成员字符串浪费空间过多的节点重新分配到新的内存上
+     * @param cur 游标, 从cur记录的(分数, 成员)开始; 没有整理完时更新为下一个待检查的节点, 整理完时重置
+     * @param limit 本次最多检查的节点个数
+     * @param misses 检查后无需重新分配的节点个数会累加到该参数
+     * @return 被重新分配的节点个数
+     * @note 续做时先按(分数, 成员)查找一次, 同时得到每一层的前驱节点; 之后直接原地修改前驱的forward指针
+     */
+    size_t defrag(DefragCursor &cur, size_t limit, size_t &misses);
+
 private:
     static constexpr int kMaxLevel = 32;
     static constexpr double kProbability = 0.25;
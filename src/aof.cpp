@@ -639,7 +639,7 @@ namespace tiny_redis {
         return true;
     }
 
-    bool AofLogger::appendRaw(const std::string &raw_resp)
+    bool AofLogger::appendRaw(std::string_view raw_resp)
     {
         if(!opts_.enabled || fd_ < 0) {
             return true;
@@ -0,0 +1,41 @@
+#include "tiny_redis/command.hpp"
+
+#include <cctype>
+
+namespace tiny_redis {
+
+    CommandTable g_commands;
+
+    void CommandTable::add(const Command &cmd)
+    {
+        cmds_[cmd.name] = cmd;
+    }
+
+    const Command *CommandTable::lookup(std::string_view name) const
+    {
+        // 命令名都很短, 转成大写后在栈上的小字符串里查找, 不需要堆分配
+        std::string upper;
+        upper.reserve(name.size());
+        for (char c : name)
+            upper.push_back(static_cast<char>(::toupper(static_cast<unsigned char>(c))));
+        auto it = cmds_.find(upper);
+        return it == cmds_.end() ? nullptr : &it->second;
+    }
+
+    std::string dispatchCommand(const RespValue &v, CommandContext &ctx)
+    {
+        if (v.type != RespType::kArray || v.array.empty())
+            return respError("ERR protocol error");
+        const auto &head = v.array[0];
+        if (head.type != RespType::kBulkString && head.type != RespType::kSimpleString)
+            return respError("ERR wrong type");
+        const Command *cmd = g_commands.lookup(head.bulk);
+        if (!cmd)
+            return respError("ERR unknown command");
+        const int argc = static_cast<int>(v.array.size());
+        if ((cmd->arity > 0 && argc != cmd->arity) || (cmd->arity < 0 && argc < -cmd->arity))
+            return respError(std::string("ERR wrong number of arguments for '") + cmd->name + "'");
+        return cmd->proc(v, ctx);
+    }
+
+}   // namespace tiny_redis
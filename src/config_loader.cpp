@@ -205,6 +205,50 @@ namespace tiny_redis {
                     return false;
                 }
             }
+            else if (key == "repl.backlog_size")
+            {
+                try
+                {
+                    cfg.repl.backlog_size = static_cast<size_t>(std::stoull(val));
+                }
+                catch (...)
+                {
+                    err = "invalid repl.backlog_size at line " + std::to_string(lineno);
+                    return false;
+                }
+            }
+            else if (key == "repl.diskless_sync")
+            {
+                cfg.repl.diskless_sync = (val == "1" || val == "true" || val == "yes");
+            }
+            else if (key == "activedefrag.enabled")
+            {
+                cfg.defrag.enabled = (val == "1" || val == "true" || val == "yes");
+            }
+            else if (key == "activedefrag.cycle_us")
+            {
+                try
+                {
+                    cfg.defrag.cycle_us = std::stoi(val);
+                }
+                catch (...)
+                {
+                    err = "invalid activedefrag.cycle_us at line " + std::to_string(lineno);
+                    return false;
+                }
+            }
+            else if (key == "activedefrag.threshold_pct")
+            {
+                try
+                {
+                    cfg.defrag.threshold_pct = std::stoi(val);
+                }
+                catch (...)
+                {
+                    err = "invalid activedefrag.threshold_pct at line " + std::to_string(lineno);
+                    return false;
+                }
+            }
             else
             {
                 // ignore unknown keys for forward compatibility
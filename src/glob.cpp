@@ -0,0 +1,189 @@
+#include "tiny_redis/glob.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace tiny_redis {
+
+    GlobMatcher::GlobMatcher(std::string_view pat)
+    {
+        size_t i = 0;
+        bool in_prefix = true; // 还在解析字面量前缀
+        while (i < pat.size())
+        {
+            char c = pat[i];
+            Op op;
+            if (c == '*')
+            {
+                ++i;
+                in_prefix = false;
+                // 连续的`*`等价于一个
+                if (!ops_.empty() && ops_.back().type == OpType::kStar)
+                    continue;
+                op.type = OpType::kStar;
+                ops_.push_back(op);
+                continue;
+            }
+            if (c == '?')
+            {
+                op.type = OpType::kAny;
+                ++i;
+            }
+            else if (c == '[')
+            {
+                op.type = OpType::kClass;
+                size_t q = i + 1;
+                bool negate = q < pat.size() && pat[q] == '^';
+                if (negate)
+                    ++q;
+                auto setBit = [&op](unsigned char b)
+                { op.set[b >> 6] |= (1ULL << (b & 63)); };
+                while (q < pat.size() && pat[q] != ']')
+                {
+                    if (pat[q] == '\\' && q + 1 < pat.size())
+                    {
+                        setBit(static_cast<unsigned char>(pat[q + 1]));
+                        q += 2;
+                    }
+                    else if (q + 2 < pat.size() && pat[q + 1] == '-' && pat[q + 2] != ']')
+                    {
+                        unsigned char lo = static_cast<unsigned char>(pat[q]);
+                        unsigned char hi = static_cast<unsigned char>(pat[q + 2]);
+                        if (lo > hi)
+                            std::swap(lo, hi);
+                        for (unsigned b = lo; b <= hi; ++b)
+                            setBit(static_cast<unsigned char>(b));
+                        q += 3;
+                    }
+                    else
+                    {
+                        setBit(static_cast<unsigned char>(pat[q]));
+                        ++q;
+                    }
+                }
+                if (negate)
+                {
+                    for (auto &w : op.set)
+                        w = ~w;
+                }
+                // 与Redis一致: 缺少`]`时把剩余部分都当作集合内容
+                i = q < pat.size() ? q + 1 : q;
+            }
+            else
+            {
+                if (c == '\\' && i + 1 < pat.size())
+                    c = pat[++i];
+                ++i;
+                if (in_prefix)
+                {
+                    prefix_.push_back(c);
+                    continue;
+                }
+                op.type = OpType::kChar;
+                op.ch = c;
+            }
+            in_prefix = false;
+            ops_.push_back(op);
+        }
+        all_star_ = std::all_of(ops_.begin(), ops_.end(), [](const Op &op)
+                                { return op.type == OpType::kStar; });
+        if (ops_.size() < 64)
+        {
+            accept_.assign(256, 0);
+            for (size_t i = 0; i < ops_.size(); ++i)
+            {
+                if (ops_[i].type == OpType::kStar)
+                {
+                    star_mask_ |= 1ULL << i;
+                    continue;
+                }
+                for (unsigned c = 0; c < 256; ++c)
+                {
+                    if (accepts(ops_[i], static_cast<unsigned char>(c)))
+                        accept_[c] |= 1ULL << i;
+                }
+            }
+        }
+    }
+
+    bool GlobMatcher::accepts(const Op &op, unsigned char c) const
+    {
+        switch (op.type)
+        {
+        case OpType::kChar:
+            return static_cast<unsigned char>(op.ch) == c;
+        case OpType::kAny:
+            return true;
+        case OpType::kClass:
+            return (op.set[c >> 6] >> (c & 63)) & 1ULL;
+        case OpType::kStar:
+            return true;
+        }
+        return false;
+    }
+
+    bool GlobMatcher::match(std::string_view s) const
+    {
+        // 1. 字面量前缀快速过滤
+        if (s.size() < prefix_.size() || std::memcmp(s.data(), prefix_.data(), prefix_.size()) != 0)
+            return false;
+        if (ops_.empty())
+            return s.size() == prefix_.size();
+        if (all_star_)
+            return true;
+        s.remove_prefix(prefix_.size());
+
+        // 2. NFA模拟: 状态i表示已经匹配完前i个操作, 状态n为接受状态
+        // 由于`*`已经合并, 任意状态的ε闭包最多向前一步
+        const size_t n = ops_.size();
+        if (!accept_.empty())
+        {
+            uint64_t st = 1;
+            st |= (st & star_mask_) << 1;
+            for (char ch : s)
+            {
+                // `*`状态吞掉字符后停留原地, 其余能接受该字符的状态前进一步
+                st = (st & star_mask_) | ((st & accept_[static_cast<unsigned char>(ch)]) << 1);
+                if (st == 0)
+                    return false;
+                st |= (st & star_mask_) << 1;
+            }
+            return (st >> n) & 1ULL;
+        }
+        std::vector<char> cur(n + 1, 0), next(n + 1, 0);
+        auto addState = [&](std::vector<char> &set, size_t st)
+        {
+            set[st] = 1;
+            if (st < n && ops_[st].type == OpType::kStar)
+                set[st + 1] = 1;
+        };
+        addState(cur, 0);
+        for (char ch : s)
+        {
+            unsigned char c = static_cast<unsigned char>(ch);
+            std::fill(next.begin(), next.end(), 0);
+            bool any = false;
+            for (size_t st = 0; st < n; ++st)
+            {
+                if (!cur[st])
+                    continue;
+                const Op &op = ops_[st];
+                if (op.type == OpType::kStar)
+                {
+                    addState(next, st); // `*`吞掉当前字符, 停留在原状态
+                    any = true;
+                }
+                else if (accepts(op, c))
+                {
+                    addState(next, st + 1);
+                    any = true;
+                }
+            }
+            if (!any)
+                return false;
+            cur.swap(next);
+        }
+        return cur[n] != 0;
+    }
+
+} // namespace tiny_redis
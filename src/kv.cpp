@@ -3,6 +3,11 @@
 #include <algorithm>
 #include <mutex>
 #include <chrono>
+#include <new>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 namespace tiny_redis
 {
@@ -11,7 +16,7 @@ namespace tiny_redis
                                         const std::string &value,
                                         std::optional<int64_t> ttl_ms)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int64_t expire_at = -1;
         if (ttl_ms.has_value())
         {
@@ -33,7 +38,7 @@ namespace tiny_redis
                                                       const std::string &value,
                                                       int64_t expire_at_ms)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         map_[key] = ValueRecord{value, expire_at_ms};
         if (expire_at_ms >= 0)
         {
@@ -43,7 +48,7 @@ namespace tiny_redis
     }
 
     std::optional<std::string> KeyValueStore::get(const std::string &key) {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int64_t now = nowMs();
         cleanupIfExpired(key, now);
         auto it = map_.find(key);
@@ -55,7 +60,7 @@ namespace tiny_redis
 
     int KeyValueStore::del(const std::vector<std::string> &keys)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int removed = 0;  // 记录被删除的key的个数
         int64_t now = nowMs();
         for(const auto &k : keys) {
@@ -72,7 +77,7 @@ namespace tiny_redis
 
     bool KeyValueStore::exists(const std::string &key)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int64_t now = nowMs();
         cleanupIfExpired(key, now);
         return map_.find(key) != map_.end() || hmap_.find(key) != hmap_.end() || zmap_.find(key) != zmap_.end();
@@ -80,7 +85,7 @@ namespace tiny_redis
 
     bool KeyValueStore::expire(const std::string &key, int64_t ttl_seconds)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int64_t now = nowMs();
         cleanupIfExpired(key, now);
         auto it = map_.find(key);
@@ -101,7 +106,7 @@ namespace tiny_redis
 
     int64_t KeyValueStore::ttl(const std::string &key)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int64_t now = nowMs();
         cleanupIfExpired(key, now);
         auto it = map_.find(key);
@@ -121,7 +126,7 @@ namespace tiny_redis
 
     int KeyValueStore::expireScanStep(int max_steps)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         if(max_steps <= 0 || expire_index_.empty()) return 0;
         int removed = 0;
         int64_t now = nowMs();
@@ -145,9 +150,229 @@ namespace tiny_redis
         return removed;
     }
 
+    namespace {
+        constexpr size_t kDefragTables = 3;
+        constexpr size_t kDefragSlice = 128;           // 集合内部每检查这么多个元素看一次时间
+        constexpr int64_t kDefragTrimIntervalMs = 10000; // malloc_trim的最小间隔
+        constexpr int64_t kRehashEntriesPerUs = 20;      // 粗略估计rehash每us能搬迁的桶与节点数
+
+        /**
+         * @brief 按桶数与节点数估计rehash(0)的代价, 判断在截止时间之前能否完成
+         * @note rehash是一次性搬迁所有节点, 不能中途停下, 因此只能事先判断; 来不及时跳过,
+         * 数百万个元素的集合在单次预算内永远来不及, 这类集合只做元素级的整理
+         */
+        template <typename Map>
+        bool rehashAffordable(const Map &m, std::chrono::steady_clock::time_point deadline)
+        {
+            const int64_t left_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                        deadline - std::chrono::steady_clock::now()).count();
+            return static_cast<int64_t>(m.bucket_count() + m.size()) <= left_us * kRehashEntriesPerUs;
+        }
+
+        /**
+         * @brief 依次整理m第bucket个桶里的记录, 游标有效时从key对应的记录继续
+         * @param fn 整理单条记录, 返回false表示该记录到截止时间仍没有整理完
+         * @return 整个桶整理完时返回true; 否则把没有整理完的记录的key写入key并返回false
+         * @note 上次没有整理完的key已不在该桶中(被删除或桶数组变化)时, 丢弃游标并从桶的开头重新整理
+         */
+        template <typename Map, typename Fn>
+        bool defragBucketOf(Map &m, size_t bucket, std::string &key, DefragCursor &cur, Fn &&fn)
+        {
+            auto it = m.begin(bucket);
+            if(cur.active) {
+                auto found = it;
+                while(found != m.end(bucket) && found->first != key) {
+                    ++found;
+                }
+                if(found == m.end(bucket)) {
+                    cur.reset();
+                } else {
+                    it = found;
+                }
+            }
+            for(; it != m.end(bucket); ++it) {
+                if(!fn(it->second)) {
+                    key = it->first;
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    int KeyValueStore::defragStep(int64_t budget_us)
+    {
+        std::lock_guard<std::recursive_mutex> lk(mu_);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(budget_us > 0 ? budget_us : 1);
+        int relocated = 0;
+        int visited = 0;
+        while(true) {
+            if(defrag_table_ == kDefragTables) {
+                // 一轮遍历结束后的收尾: 每次收缩一个表, 与遍历共用同一个时间预算
+                if(defrag_bucket_ <= kDefragTables) {
+                    defragShrinkTable(defrag_bucket_++, deadline);
+                    if(std::chrono::steady_clock::now() >= deadline) {
+                        break;
+                    }
+                    continue;
+                }
+#ifdef __GLIBC__
+                // 把堆顶以及空闲块所在的整页归还给操作系统, 这一步才真正降低RSS;
+                // malloc_trim需要遍历整个堆, 数据集很小时每次都会走到这里, 因此限制调用频率
+                int64_t now_ms = nowMs();
+                if(now_ms - defrag_last_trim_ms_ >= kDefragTrimIntervalMs) {
+                    defrag_last_trim_ms_ = now_ms;
+                    ::malloc_trim(0);
+                }
+#endif
+                defrag_table_ = 0;
+                defrag_bucket_ = 0;
+                break;
+            }
+            size_t nbuckets = defrag_table_ == 0 ? map_.bucket_count()
+                            : defrag_table_ == 1 ? hmap_.bucket_count() : zmap_.bucket_count();
+            if(defrag_bucket_ >= nbuckets) {
+                defrag_bucket_ = 0;
+                defrag_cursor_.reset();
+                ++defrag_table_;
+                continue;
+            }
+            if(!defragBucket(defrag_table_, defrag_bucket_, deadline, relocated)) {
+                // 桶内的大集合整理到一半, 游标已保存
+                break;
+            }
+            ++defrag_bucket_;
+            // 每处理16个桶检查一次时间, 避免频繁读取时钟
+            if((++visited & 15) == 0 && std::chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+        }
+        return relocated;
+    }
+
+    void KeyValueStore::defragShrinkTable(size_t idx, std::chrono::steady_clock::time_point deadline)
+    {
+        // 删除大量key之后哈希表不会自动收缩桶数组, 这里在负载过低时手动收缩
+        auto shrink = [&](auto &m) {
+            if(m.load_factor() < 0.25f && rehashAffordable(m, deadline)) {
+                m.rehash(0);
+            }
+        };
+        switch(idx) {
+        case 0: shrink(map_); break;
+        case 1: shrink(hmap_); break;
+        case 2: shrink(zmap_); break;
+        default: shrink(expire_index_); break;
+        }
+    }
+
+    bool KeyValueStore::defragBucket(size_t table, size_t bucket, std::chrono::steady_clock::time_point deadline,
+                                     int &relocated)
+    {
+        DefragCursor &cur = defrag_cursor_;
+        // 按片整理一个集合直到整理完或超过截止时间, 返回是否整理完
+        auto sliced = [&](auto &&slice) {
+            do {
+                slice();
+            } while(cur.active && std::chrono::steady_clock::now() < deadline);
+            return !cur.active;
+        };
+        // 集合被大量删除后桶数组依旧保持峰值大小; 只在开始整理该集合时收缩, 避免桶下标游标失效
+        auto shrinkMembers = [&](auto &m) {
+            if(!cur.active && m.bucket_count() > 4 * (m.size() + 1) && rehashAffordable(m, deadline)) {
+                m.rehash(0);
+                ++defrag_hits_;
+                ++relocated;
+            }
+        };
+        if(table == 0) {
+            return defragBucketOf(map_, bucket, defrag_key_, cur, [&](ValueRecord &rec) {
+                relocated += defragString(rec.value) ? 1 : 0;
+                return true;
+            });
+        }
+        if(table == 1) {
+            return defragBucketOf(hmap_, bucket, defrag_key_, cur, [&](HashRecord &rec) {
+                auto &fields = rec.fields;
+                shrinkMembers(fields);
+                return sliced([&] {
+                    // 空桶也计入工作量, 大量删除之后来不及收缩的桶数组里大部分是空桶
+                    size_t b = cur.active ? cur.pos : 0;
+                    size_t checked = 0;
+                    for(; b < fields.bucket_count() && checked < kDefragSlice; ++b, ++checked) {
+                        for(auto it = fields.begin(b); it != fields.end(b); ++it, ++checked) {
+                            relocated += defragString(it->second) ? 1 : 0;
+                        }
+                    }
+                    if(b < fields.bucket_count()) {
+                        cur.active = true;
+                        cur.pos = b;
+                    } else {
+                        cur.reset();
+                    }
+                });
+            });
+        }
+        return defragBucketOf(zmap_, bucket, defrag_key_, cur, [&](ZSetRecord &rec) {
+            if(!cur.active) {
+                shrinkMembers(rec.member_to_score);
+                if(!rec.use_skiplist && rec.items.capacity() > 2 * rec.items.size()) {
+                    rec.items.shrink_to_fit();
+                    ++defrag_hits_;
+                    ++relocated;
+                }
+            }
+            return sliced([&] {
+                if(rec.use_skiplist) {
+                    size_t misses = 0;
+                    size_t hits = rec.sl->defrag(cur, kDefragSlice, misses);
+                    defrag_hits_ += static_cast<int64_t>(hits);
+                    defrag_misses_ += static_cast<int64_t>(misses);
+                    relocated += static_cast<int>(hits);
+                    return;
+                }
+                size_t i = cur.active ? cur.pos : 0;
+                const size_t end = std::min(rec.items.size(), i + kDefragSlice);
+                for(; i < end; ++i) {
+                    relocated += defragString(rec.items[i].second) ? 1 : 0;
+                }
+                if(i < rec.items.size()) {
+                    cur.active = true;
+                    cur.pos = i;
+                } else {
+                    cur.reset();
+                }
+            });
+        });
+    }
+
+    bool KeyValueStore::defragString(std::string &s)
+    {
+        if(!shouldRelocate(s)) {
+            ++defrag_misses_;
+            return false;
+        }
+        // 拷贝出一份按实际长度分配的新字符串, 再与旧的交换, 旧的内存随临时对象释放
+        std::string(s).swap(s);
+        ++defrag_hits_;
+        return true;
+    }
+
+    int64_t KeyValueStore::defragHits() const
+    {
+        std::lock_guard<std::recursive_mutex> lk(mu_);
+        return defrag_hits_;
+    }
+
+    int64_t KeyValueStore::defragMisses() const
+    {
+        std::lock_guard<std::recursive_mutex> lk(mu_);
+        return defrag_misses_;
+    }
+
     std::vector<std::pair<std::string, ValueRecord>> KeyValueStore::snapshot() const
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         std::vector<std::pair<std::string, ValueRecord>> out;
         out.reserve(map_.size());  // 预分配内存
         for(const auto &kv : map_) {
@@ -158,7 +383,7 @@ namespace tiny_redis
 
     std::vector<std::pair<std::string, HashRecord>> KeyValueStore::snapshotHash() const
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         std::vector<std::pair<std::string, HashRecord>> out;
         out.reserve(hmap_.size());
         for(const auto &kv : hmap_) {
@@ -169,7 +394,7 @@ namespace tiny_redis
 
     std::vector<ZSetFlat> KeyValueStore::snapshotZSet() const
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         std::vector<ZSetFlat> out;
         out.reserve(zmap_.size());
         for(const auto &kv : zmap_) {
@@ -187,35 +412,215 @@ namespace tiny_redis
         return out;
     }
 
-    std::vector<std::string> KeyValueStore::listKeys() const
+    pid_t KeyValueStore::forkSnapshot() const
+    {
+        // 不能用lock_guard: 子进程里需要重新初始化锁而不是解锁
+        mu_.lock();
+        pid_t pid = ::fork();
+        if(pid == 0) {
+            // 子进程只有调用fork的这一个线程, 锁的持有者信息已经失效, 直接原地重建
+            new (&mu_) std::recursive_mutex();
+            return 0;
+        }
+        mu_.unlock();
+        return pid;
+    }
+
+    bool KeyValueStore::visitStrings(const std::function<bool(const std::string &, const ValueRecord &)> &fn) const
+    {
+        std::lock_guard<std::recursive_mutex> lk(mu_);
+        for(const auto &kv : map_) {
+            if(!fn(kv.first, kv.second)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool KeyValueStore::visitHashes(const std::function<bool(const std::string &, const HashRecord &)> &fn) const
+    {
+        std::lock_guard<std::recursive_mutex> lk(mu_);
+        for(const auto &kv : hmap_) {
+            if(!fn(kv.first, kv.second)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool KeyValueStore::visitZSets(const std::function<bool(const std::string &, const ZSetRecord &)> &fn) const
+    {
+        std::lock_guard<std::recursive_mutex> lk(mu_);
+        for(const auto &kv : zmap_) {
+            if(!fn(kv.first, kv.second)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void KeyValueStore::clear()
+    {
+        std::lock_guard<std::recursive_mutex> lk(mu_);
+        map_.clear();
+        hmap_.clear();
+        zmap_.clear();
+        expire_index_.clear();
+        defrag_table_ = 0;
+        defrag_bucket_ = 0;
+        defrag_key_.clear();
+        defrag_cursor_.reset();
+    }
+
+    std::vector<std::string> KeyValueStore::listKeys(const GlobMatcher &pattern) const
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
+        int64_t now = nowMs();
         std::vector<std::string> out{};
-        out.reserve(map_.size() + hmap_.size() + zmap_.size());
+        // 字面量前缀由GlobMatcher::match内部先行比较, 不匹配前缀的key只需一次memcmp
         for(const auto &kv : map_) {
-            out.push_back(kv.first);
+            if(!isExpired(kv.second, now) && pattern.match(kv.first)) {
+                out.push_back(kv.first);
+            }
         }
+        // 通过查找之前的表来去重, 避免对整个结果排序
         for(const auto &kv : hmap_) {
-            out.push_back(kv.first);
+            if(!isExpired(kv.second, now) && pattern.match(kv.first) && map_.find(kv.first) == map_.end()) {
+                out.push_back(kv.first);
+            }
         }
         for(const auto &kv : zmap_) {
-            out.push_back(kv.first);
+            if(!isExpired(kv.second, now) && pattern.match(kv.first) &&
+               map_.find(kv.first) == map_.end() && hmap_.find(kv.first) == hmap_.end()) {
+                out.push_back(kv.first);
+            }
+        }
+        return out;
+    }
+
+    namespace {
+
+        // 游标布局: [63..62]表下标 [61..0]表内的反向二进制游标
+        constexpr int kScanTableShift = 62;
+
+        uint64_t reverseBits(uint64_t v)
+        {
+            v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+            v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+            v = ((v >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((v & 0x0F0F0F0F0F0F0F0FULL) << 4);
+            return __builtin_bswap64(v);
         }
-        // 去重
-        std::sort(out.begin(), out.end());
 
         /**
-         * `std::unique(out.begin(), out.end())` 这个算法会遍历已排序的容器,
-         * 将连续重复的元素移动到容器的末尾, 并返回一个指向第一个重复元素的迭代器
-         * @note 该函数并不真正删除元素, 只是将重复元素移到后面
+         * @brief 用反向二进制游标增量遍历一个Dict
+         * @param cursor 不含表下标的游标
+         * @param budget 剩余可访问的非空桶个数, 返回时扣除本次消耗
+         * @return 下一次调用的游标(不含表下标), 返回0表示该表遍历结束
+         * @note 游标每次在桶下标的最高位上加一(反向二进制加法). 桶数组为2的幂, 扩容后旧桶b的元素只会落在
+         * 低位等于b的新桶里, 这些新桶在反向二进制顺序中恰好排在一起, 因此扩缩容都不会漏掉已经存在的元素
          */
-        out.erase(std::unique(out.begin(), out.end()), out.end());
-        return out;
+        template <typename Map, typename Fn>
+        uint64_t scanBuckets(const Map &m, uint64_t cursor, size_t &budget, Fn &&fn)
+        {
+            if(m.empty()) {
+                return 0;
+            }
+            const uint64_t mask = m.bucket_count() - 1;
+            uint64_t v = cursor;
+            // 连续的空桶也要计入工作量, 防止在大量删除后的稀疏表上空转
+            size_t empty_budget = budget * 10;
+            do {
+                const size_t b = static_cast<size_t>(v & mask);
+                if(m.begin(b) == m.end(b)) {
+                    --empty_budget;
+                } else {
+                    --budget;
+                    for(auto it = m.begin(b); it != m.end(b); ++it) {
+                        fn(*it);
+                    }
+                }
+                // 把mask以外的位全部置1, 这样翻转后加一的进位会直接落在有效位上
+                v |= ~mask;
+                v = reverseBits(reverseBits(v) + 1);
+            } while(v != 0 && budget > 0 && empty_budget > 0);
+            return v;
+        }
+
+    } // namespace
+
+    uint64_t KeyValueStore::scan(uint64_t cursor, size_t count, const std::string &type, std::vector<std::string> &out) const
+    {
+        std::lock_guard<std::recursive_mutex> lk(mu_);
+        int64_t now = nowMs();
+        size_t budget = count > 0 ? count : 10;
+        uint64_t table = cursor >> kScanTableShift;
+        uint64_t inner = cursor & ~(3ULL << kScanTableShift);
+        // 同一个key只在它出现的第一个表中返回, 与listKeys的去重规则一致
+        auto firstSeen = [&](const std::string &key, uint64_t t) {
+            return (t <= 0 || map_.find(key) == map_.end()) && (t <= 1 || hmap_.find(key) == hmap_.end());
+        };
+        while(table < 3 && budget > 0) {
+            static const char *kTypeNames[] = {"string", "hash", "zset"};
+            if(!type.empty() && type != kTypeNames[table]) {
+                ++table;
+                inner = 0;
+                continue;
+            }
+            auto emit = [&](const auto &kv) {
+                if(!isExpired(kv.second, now) && firstSeen(kv.first, table)) out.push_back(kv.first);
+            };
+            if(table == 0) {
+                inner = scanBuckets(map_, inner, budget, emit);
+            } else if(table == 1) {
+                inner = scanBuckets(hmap_, inner, budget, emit);
+            } else {
+                inner = scanBuckets(zmap_, inner, budget, emit);
+            }
+            if(inner != 0) {
+                break;
+            }
+            ++table;
+        }
+        if(table >= 3) {
+            return 0;
+        }
+        return (table << kScanTableShift) | inner;
+    }
+
+    uint64_t KeyValueStore::hscan(const std::string &key, uint64_t cursor, size_t count, std::vector<std::string> &out)
+    {
+        std::lock_guard<std::recursive_mutex> lk(mu_);
+        int64_t now = nowMs();
+        cleanupIfExpiredHash(key, now);
+        auto it = hmap_.find(key);
+        if(it == hmap_.end()) {
+            return 0;
+        }
+        size_t budget = count > 0 ? count : 10;
+        return scanBuckets(it->second.fields, cursor, budget, [&](const auto &fv) {
+            out.push_back(fv.first);
+            out.push_back(fv.second);
+        });
+    }
+
+    uint64_t KeyValueStore::zscan(const std::string &key, uint64_t cursor, size_t count, std::vector<std::pair<std::string, double>> &out)
+    {
+        std::lock_guard<std::recursive_mutex> lk(mu_);
+        int64_t now = nowMs();
+        cleanupIfExpiredZSet(key, now);
+        auto it = zmap_.find(key);
+        if(it == zmap_.end()) {
+            return 0;
+        }
+        size_t budget = count > 0 ? count : 10;
+        return scanBuckets(it->second.member_to_score, cursor, budget, [&](const auto &ms) {
+            out.emplace_back(ms.first, ms.second);
+        });
     }
 
     int KeyValueStore::hset(const std::string &key, const std::string &field, const std::string &value)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int64_t now = nowMs();
         cleanupIfExpiredHash(key, now);
         auto &rec = hmap_[key];
@@ -231,7 +636,7 @@ namespace tiny_redis
 
     std::optional<std::string> KeyValueStore::hget(const std::string &key, const std::string &field)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int64_t now = nowMs();
         cleanupIfExpiredHash(key, now);
         auto it = hmap_.find(key);
@@ -245,7 +650,7 @@ namespace tiny_redis
 
     int KeyValueStore::hdel(const std::string &key, const std::vector<std::string> &fields)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int64_t now = nowMs();
         cleanupIfExpiredHash(key, now);
         auto it = hmap_.find(key);
@@ -270,7 +675,7 @@ namespace tiny_redis
 
     bool KeyValueStore::hexists(const std::string &key, const std::string &field)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int64_t now = nowMs();
         cleanupIfExpiredHash(key, now);
         auto it = hmap_.find(key);
@@ -282,7 +687,7 @@ namespace tiny_redis
 
     std::vector<std::string> KeyValueStore::hgetallFlat(const std::string &key)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int64_t now = nowMs();
         cleanupIfExpiredHash(key, now);
         std::vector<std::string> out;
@@ -301,7 +706,7 @@ namespace tiny_redis
 
     int KeyValueStore::hlen(const std::string &key)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int64_t now = nowMs();
         cleanupIfExpiredHash(key, now);
         auto it = hmap_.find(key);
@@ -313,7 +718,7 @@ namespace tiny_redis
 
     bool KeyValueStore::setHashExpireAtMs(const std::string &key, int64_t expire_at_ms)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         auto it = hmap_.find(key);
         if (it == hmap_.end()) {
             return false;
@@ -329,7 +734,7 @@ namespace tiny_redis
 
     int KeyValueStore::zadd(const std::string &key, double score, const std::string &member)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int64_t now = nowMs();
         cleanupIfExpiredZSet(key, now);
         auto &rec = zmap_[key];
@@ -425,7 +830,7 @@ namespace tiny_redis
 
     int KeyValueStore::zrem(const std::string &key, const std::vector<std::string> &members)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int64_t now = nowMs();
         cleanupIfExpiredZSet(key, now);
         auto it = zmap_.find(key);
@@ -474,7 +879,7 @@ namespace tiny_redis
 
     std::vector<std::string> KeyValueStore::zrange(const std::string &key, int64_t start, int64_t stop)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int64_t now = nowMs();
         cleanupIfExpiredZSet(key, now);
         std::vector<std::string> out{};
@@ -523,7 +928,7 @@ namespace tiny_redis
 
     std::optional<double> KeyValueStore::zscore(const std::string &key, const std::string &member)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         int64_t now = nowMs();
         cleanupIfExpiredZSet(key, now);
         auto it = zmap_.find(key);
@@ -541,7 +946,7 @@ namespace tiny_redis
 
     bool KeyValueStore::setZSetExpireAtMs(const std::string &key, int64_t expire_at_ms)
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<std::recursive_mutex> lk(mu_);
         auto it = zmap_.find(key);
         if (it == zmap_.end()) {
             return false;
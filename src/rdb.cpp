@@ -4,8 +4,13 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <filesystem>
+#include <charconv>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 
 namespace tiny_redis {
 
@@ -19,6 +24,100 @@ namespace tiny_redis {
         return dir + '/' + file;
     }
 
+    // 字符串格式: key长度 key value长度 value 过期时间戳
+    static void encodeString(std::string &out, const std::string &k, const std::string &v, int64_t expire_at_ms)
+    {
+        out.append(std::to_string(k.size())).append(" ").append(k).append(" ")
+            .append(std::to_string(v.size())).append(" ").append(v)
+            .append(" ").append(std::to_string(expire_at_ms)).append("\n");
+    }
+
+    // HASH/ZSET的头部格式: key长度 key 过期时间戳 字段个数
+    static void encodeHead(std::string &out, const std::string &k, int64_t expire_at_ms, size_t n)
+    {
+        out.append(std::to_string(k.size())).append(" ").append(k).append(" ")
+            .append(std::to_string(expire_at_ms)).append(" ").append(std::to_string(n)).append("\n");
+    }
+
+    // @brief 把数据完整写入fd, 被信号中断时重试
+    static bool writeAll(int fd, const char *data, size_t len)
+    {
+        while(len > 0) {
+            ssize_t w = ::write(fd, data, len);
+            if(w < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data += w;
+            len -= static_cast<size_t>(w);
+        }
+        return true;
+    }
+
+    bool Rdb::writeSnapshot(const KeyValueStore &store, const RdbSink &sink, std::string &err)
+    {
+        constexpr size_t kChunk = 64 * 1024; // 攒够一个数据块再交给sink
+
+        std::string chunk;
+        chunk.reserve(kChunk * 2);
+        auto flush = [&](bool force) -> bool {
+            if(chunk.empty() || (!force && chunk.size() < kChunk)) {
+                return true;
+            }
+            if(!sink(chunk.data(), chunk.size())) {
+                err = "write rdb chunk";
+                return false;
+            }
+            chunk.clear();
+            return true;
+        };
+
+        // 写入头部以及字符串段, 已过期但尚未删除的记录原样写出, 加载时跳过
+        chunk.append("MRDB2\n").append("STR ").append(std::to_string(store.size())).append("\n");
+        bool ok = store.visitStrings([&](const std::string &k, const ValueRecord &r) {
+            encodeString(chunk, k, r.value, r.expire_at_ms);
+            return flush(false);
+        });
+        if(!ok) {
+            return false;
+        }
+        // HASH section
+        chunk.append("HASH ").append(std::to_string(store.hashSize())).append("\n");
+        ok = store.visitHashes([&](const std::string &k, const HashRecord &r) {
+            encodeHead(chunk, k, r.expire_at_ms, r.fields.size());
+            for(const auto &fv : r.fields) {
+                chunk.append(std::to_string(fv.first.size())).append(" ").append(fv.first).append(" ")
+                    .append(std::to_string(fv.second.size())).append(" ").append(fv.second).append("\n");
+                if(!flush(false)) {
+                    return false;
+                }
+            }
+            return true;
+        });
+        if(!ok) {
+            return false;
+        }
+        // ZSET section, 成员顺序不影响加载结果, 直接遍历member_to_score而不必按分数排序
+        chunk.append("ZSET ").append(std::to_string(store.zsetSize())).append("\n");
+        ok = store.visitZSets([&](const std::string &k, const ZSetRecord &r) {
+            encodeHead(chunk, k, r.expire_at_ms, r.member_to_score.size());
+            for(const auto &ms : r.member_to_score) {
+                chunk.append(std::to_string(ms.second)).append(" ").append(std::to_string(ms.first.size()))
+                    .append(" ").append(ms.first).append("\n");
+                if(!flush(false)) {
+                    return false;
+                }
+            }
+            return true;
+        });
+        if(!ok) {
+            return false;
+        }
+        return flush(true);
+    }
+
     bool Rdb::save(const KeyValueStore &store, std::string &err) const
     {
         if(!opts_.enabled) {
@@ -28,123 +127,47 @@ namespace tiny_redis {
         std::error_code ec;
         std::filesystem::create_directories(opts_.dir, ec);
 
-        // 打开要写入的RDB文件的文件描述符
-        int fd = ::open(path().c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        // 先写临时文件, 成功后再rename覆盖, 保存失败时不会破坏已有的RDB文件
+        const std::string final_path = path();
+        const std::string tmp_path = final_path + ".tmp";
+        int fd = ::open(tmp_path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
         if (fd < 0)
         {
             err = "open rdb failed";
             return false;
         }
-        auto snap_str = store.snapshot();           // 字符串的快照
-        auto snap_hash = store.snapshotHash();      // 哈希表的快照
-        auto snap_zset = store.snapshotZSet();      // 排序set的快照
-
-        // 写入头部
-        std::string header = std::string("MRDB2\n");
-        if (::write(fd, header.data(), header.size()) < 0)
-        {
-            ::close(fd);
-            err = "write hdr";
-            return false;
+        // 由子进程写出fork那一刻的数据集, 父进程既不拷贝数据也不在写文件期间持有store的锁
+        pid_t pid = store.forkSnapshot();
+        if(pid == 0) {
+            std::string child_err;
+            bool ok = writeSnapshot(store, [fd](const char *data, size_t len) {
+                return writeAll(fd, data, len);
+            }, child_err) && ::fsync(fd) == 0;
+            ::_exit(ok ? 0 : 1);
         }
-        std::string line = std::string("STR ") + std::to_string(snap_str.size()) + "\n";    // 在头部写入字符串的长度
-        if (::write(fd, line.data(), line.size()) < 0)
-        {
-            ::close(fd);
-            err = "write str cnt";
+        ::close(fd);
+        if(pid < 0) {
+            ::unlink(tmp_path.c_str());
+            err = "fork failed";
             return false;
         }
-        for (const auto &kv : snap_str)
-        {
-            const std::string &k = kv.first;
-            const ValueRecord &r = kv.second;
-            std::string rec;
-            // 字符串格式: 字符串长度+键key+值长度+值value+过期时间戳+"\n"
-            rec.append(std::to_string(k.size())).append(" ").append(k).append(" ")
-                .append(std::to_string(r.value.size())).append(" ").append(r.value)
-                .append(" ").append(std::to_string(r.expire_at_ms)).append("\n");
-            if (::write(fd, rec.data(), rec.size()) < 0)
-            {
-                ::close(fd);
-                err = "write str rec";
-                return false;
+        int status = 0;
+        while(::waitpid(pid, &status, 0) < 0) {
+            if(errno != EINTR) {
+                status = -1;
+                break;
             }
         }
-        // HASH section
-        line = std::string("HASH ") + std::to_string(snap_hash.size()) + "\n";
-        if (::write(fd, line.data(), line.size()) < 0)
-        {
-            ::close(fd);
-            err = "write hash cnt";
+        if(status != 0) {
+            ::unlink(tmp_path.c_str());
+            err = "write rdb failed";
             return false;
         }
-        for (const auto &kv : snap_hash)
-        {
-            const std::string &k = kv.first;
-            const HashRecord &r = kv.second;
-            std::string rec_head;
-            // HASH格式: 总长度+键key+过期时间戳+key值域的总长度
-            rec_head.append(std::to_string(k.size())).append(" ")
-                    .append(k).append(" ").append(std::to_string(r.expire_at_ms))
-                    .append(" ").append(std::to_string(r.fields.size())).append("\n");
-            if (::write(fd, rec_head.data(), rec_head.size()) < 0)
-            {
-                ::close(fd);
-                err = "write hash head";
-                return false;
-            }
-            // 格式续接:
-            for (const auto &fv : r.fields)
-            {
-                std::string fline;
-                fline.append(std::to_string(fv.first.size()))
-                    .append(" ").append(fv.first).append(" ").append(std::to_string(fv.second.size()))
-                    .append(" ").append(fv.second).append("\n");
-                if (::write(fd, fline.data(), fline.size()) < 0)
-                {
-                    ::close(fd);
-                    err = "write hash field";
-                    return false;
-                }
-            }
-        }
-        // ZSET格式头部:
-        line = std::string("ZSET ") + std::to_string(snap_zset.size()) + "\n";
-        if (::write(fd, line.data(), line.size()) < 0)
-        {
-            ::close(fd);
-            err = "write zset cnt";
+        if(::rename(tmp_path.c_str(), final_path.c_str()) != 0) {
+            ::unlink(tmp_path.c_str());
+            err = "rename rdb failed";
             return false;
         }
-        for (const auto &flat : snap_zset)
-        {
-            const std::string &k = flat.key;
-            std::string rec_head;
-            rec_head.append(std::to_string(k.size())).append(" ")
-                .append(k).append(" ").append(std::to_string(flat.expire_at_ms)).append(" ")
-                .append(std::to_string(flat.items.size())).append("\n");
-            if (::write(fd, rec_head.data(), rec_head.size()) < 0)
-            {
-                ::close(fd);
-                err = "write zset head";
-                return false;
-            }
-            for (const auto &it : flat.items)
-            {
-                const double score = it.first;
-                const std::string &member = it.second;
-                std::string iline;
-                iline.append(std::to_string(score)).append(" ").append(std::to_string(member.size())).append(" ").append(member).append("\n");
-                if (::write(fd, iline.data(), iline.size()) < 0)
-                {
-                    ::close(fd);
-                    err = "write zset item";
-                    return false;
-                }
-            }
-        }
-        ::fsync(fd);
-        ::close(fd);
         return true;
     }
 
@@ -155,232 +178,241 @@ namespace tiny_redis {
         int fd = ::open(path().c_str(), O_RDONLY);
         if (fd < 0)
             return true; // no file is fine
+        // 分块读取文件并交给流式解析器, 不需要把整个文件读进内存
+        RdbStreamLoader loader(store);
         std::string data;
         data.resize(1 << 20);
-        std::string file;
         while (true)
         {
             ssize_t r = ::read(fd, data.data(), data.size());
             if (r < 0)
             {
+                if (errno == EINTR)
+                    continue;
                 ::close(fd);
                 err = "read rdb";
                 return false;
             }
             if (r == 0)
                 break;
-            file.append(data.data(), static_cast<size_t>(r));
-        }
-        ::close(fd);
-        size_t pos = 0;
-        auto readLine = [&](std::string &out) -> bool
-        { size_t e = file.find('\n', pos); if (e==std::string::npos) return false; out.assign(file.data()+pos, e-pos); pos=e+1; return true; };
-        std::string line;
-        if (!readLine(line))
-        {
-            err = "bad magic";
-            return false;
-        }
-        if (line == "MRDB1")
-        {
-            // backward compat for strings only
-            if (!readLine(line))
+            if (!loader.feed(data.data(), static_cast<size_t>(r), err))
             {
-                err = "no count";
+                ::close(fd);
                 return false;
             }
-            int count = std::stoi(line);
-            for (int i = 0; i < count; ++i)
-            {
-                if (!readLine(line))
-                {
-                    err = "trunc rec";
-                    return false;
-                }
-                size_t p = 0;
-                auto nextTok = [&](std::string &tok) -> bool
-                { size_t s = p; while (s < line.size() && line[s]==' ') ++s; size_t q = line.find(' ', s); if (q == std::string::npos) { tok = line.substr(s); p = line.size(); return true; } tok = line.substr(s, q-s); p = q+1; return true; };
-                std::string key_len_s;
-                nextTok(key_len_s);
-                int klen = std::stoi(key_len_s);
-                std::string key = line.substr(p, static_cast<size_t>(klen));
-                p += static_cast<size_t>(klen) + 1;
-                std::string val_len_s;
-                nextTok(val_len_s);
-                int vlen = std::stoi(val_len_s);
-                std::string val = line.substr(p, static_cast<size_t>(vlen));
-                p += static_cast<size_t>(vlen) + 1;
-                std::string exp_s;
-                nextTok(exp_s);
-                int64_t exp = std::stoll(exp_s);
-                store.setWithExpireAtMs(key, val, exp);
-            }
-            return true;
         }
-        if (line != "MRDB2")
+        ::close(fd);
+        if (!loader.done())
         {
-            err = "bad magic";
+            err = "truncated rdb";
             return false;
         }
-        // STR section
-        if (!readLine(line))
+        return true;
+    }
+
+    // @brief 读取以delim结尾的一个整数, 数据不完整返回0, 格式错误返回-1
+    template <typename T>
+    static int readNum(const std::string &buf, size_t &p, char delim, T &out)
+    {
+        size_t e = buf.find(delim, p);
+        if (e == std::string::npos)
+            return 0;
+        auto res = std::from_chars(buf.data() + p, buf.data() + e, out);
+        if (res.ec != std::errc() || res.ptr != buf.data() + e)
+            return -1;
+        p = e + 1;
+        return 1;
+    }
+
+    // @brief 读取n个字节以及紧随其后的分隔符
+    static int readBytes(const std::string &buf, size_t &p, size_t n, char delim, std::string &out)
+    {
+        if (buf.size() - p < n + 1)
+            return 0;
+        if (buf[p + n] != delim)
+            return -1;
+        out.assign(buf.data() + p, n);
+        p += n + 1;
+        return 1;
+    }
+
+    bool RdbStreamLoader::feed(const char *data, size_t len, std::string &err)
+    {
+        buf_.append(data, len);
+        int rc;
+        while (state_ != State::kDone && (rc = parseOne(err)) > 0)
         {
-            err = "no str section";
-            return false;
         }
-        if (line.rfind("STR ", 0) != 0)
+        if (state_ != State::kDone && rc < 0)
         {
-            err = "no str tag";
+            if (err.empty())
+                err = "bad rdb record";
             return false;
         }
-        int str_count = std::stoi(line.substr(4));
-        for (int i = 0; i < str_count; ++i)
-        {
-            if (!readLine(line))
+        // 已解析的部分从缓冲区中移除, 缓冲区中只保留最后一条不完整的记录
+        buf_.erase(0, pos_);
+        pos_ = 0;
+        return true;
+    }
+
+    int RdbStreamLoader::parseOne(std::string &err)
+    {
+        size_t p = pos_;
+        int rc = 1;
+        const int64_t now = KeyValueStore::nowMs();
+        // 读取形如"TAG n\n"的段头部
+        auto sectionHead = [&](const char *tag, State next) -> int {
+            size_t tl = std::strlen(tag);
+            if (buf_.size() - p < tl)
+                return 0;
+            if (buf_.compare(p, tl, tag) != 0)
             {
-                err = "trunc str rec";
-                return false;
+                err = std::string("no ") + tag + "section";
+                return -1;
             }
-            size_t p = 0;
-            auto nextTok = [&](std::string &tok) -> bool
-            { size_t s = p; while (s < line.size() && line[s]==' ') ++s; size_t q = line.find(' ', s); if (q == std::string::npos) { tok = line.substr(s); p = line.size(); return true; } tok = line.substr(s, q-s); p = q+1; return true; };
-            std::string key_len_s;
-            nextTok(key_len_s);
-            int klen = std::stoi(key_len_s);
-            std::string key = line.substr(p, static_cast<size_t>(klen));
-            p += static_cast<size_t>(klen) + 1;
-            std::string val_len_s;
-            nextTok(val_len_s);
-            int vlen = std::stoi(val_len_s);
-            std::string val = line.substr(p, static_cast<size_t>(vlen));
-            p += static_cast<size_t>(vlen) + 1;
-            std::string exp_s;
-            nextTok(exp_s);
-            int64_t exp = std::stoll(exp_s);
-            store.setWithExpireAtMs(key, val, exp);
-        }
-        // HASH section
-        if (!readLine(line))
-        {
-            err = "no hash section";
-            return false;
-        }
-        if (line.rfind("HASH ", 0) != 0)
+            p += tl;
+            int r = readNum(buf_, p, '\n', remaining_);
+            if (r > 0)
+                state_ = next;
+            return r;
+        };
+
+        switch (state_)
         {
-            err = "no hash tag";
-            return false;
-        }
-        int hash_count = std::stoi(line.substr(5));
-        for (int i = 0; i < hash_count; ++i)
+        case State::kMagic:
         {
-            if (!readLine(line))
-            {
-                err = "trunc hash head";
-                return false;
-            }
-            size_t p = 0;
-            auto nextTok = [&](std::string &tok) -> bool
-            { size_t s = p; while (s < line.size() && line[s]==' ') ++s; size_t q = line.find(' ', s); if (q == std::string::npos) { tok = line.substr(s); p = line.size(); return true; } tok = line.substr(s, q-s); p = q+1; return true; };
-            std::string klen_s;
-            nextTok(klen_s);
-            int klen = std::stoi(klen_s);
-            std::string key = line.substr(p, static_cast<size_t>(klen));
-            p += static_cast<size_t>(klen) + 1;
-            std::string exp_s;
-            nextTok(exp_s);
-            int64_t exp = std::stoll(exp_s);
-            std::string nfields_s;
-            nextTok(nfields_s);
-            int nf = std::stoi(nfields_s);
-            bool has_any = false;
-            std::vector<std::pair<std::string, std::string>> fvs;
-            fvs.reserve(nf);
-            for (int j = 0; j < nf; ++j)
+            size_t e = buf_.find('\n', p);
+            if (e == std::string::npos)
+                return buf_.size() - p > 8 ? -1 : 0;
+            std::string magic = buf_.substr(p, e - p);
+            p = e + 1;
+            if (magic == "MRDB1")
             {
-                if (!readLine(line))
-                {
-                    err = "trunc hash field";
-                    return false;
-                }
-                size_t q = 0;
-                auto nextTok2 = [&](std::string &tok) -> bool
-                { size_t s = q; while (s < line.size() && line[s]==' ') ++s; size_t x = line.find(' ', s); if (x == std::string::npos) { tok = line.substr(s); q = line.size(); return true; } tok = line.substr(s, x-s); q = x+1; return true; };
-                std::string flen_s;
-                nextTok2(flen_s);
-                int flen = std::stoi(flen_s);
-                std::string field = line.substr(q, static_cast<size_t>(flen));
-                q += static_cast<size_t>(flen) + 1;
-                std::string vlen_s;
-                nextTok2(vlen_s);
-                int vlen = std::stoi(vlen_s);
-                std::string val = line.substr(q, static_cast<size_t>(vlen));
-                fvs.emplace_back(std::move(field), std::move(val));
-                has_any = true;
+                // 旧格式: 只有字符串, 没有段标签
+                v1_ = true;
+                state_ = State::kStrCount;
             }
-            if (has_any)
+            else if (magic == "MRDB2")
+                state_ = State::kStrCount;
+            else
             {
-                for (const auto &fv : fvs)
-                    store.hset(key, fv.first, fv.second);
-                if (exp >= 0)
-                    store.setHashExpireAtMs(key, exp);
+                err = "bad magic";
+                return -1;
             }
+            break;
         }
-        // ZSET section
-        if (!readLine(line))
+        case State::kStrCount:
+            rc = v1_ ? readNum(buf_, p, '\n', remaining_) : sectionHead("STR ", State::kStr);
+            if (rc > 0)
+                state_ = State::kStr;
+            break;
+        case State::kStr:
         {
-            err = "no zset section";
-            return false;
+            if (remaining_ == 0)
+            {
+                state_ = v1_ ? State::kDone : State::kHashCount;
+                break;
+            }
+            size_t klen = 0, vlen = 0;
+            int64_t exp = -1;
+            std::string key, val;
+            if ((rc = readNum(buf_, p, ' ', klen)) <= 0 || (rc = readBytes(buf_, p, klen, ' ', key)) <= 0 ||
+                (rc = readNum(buf_, p, ' ', vlen)) <= 0 || (rc = readBytes(buf_, p, vlen, ' ', val)) <= 0 ||
+                (rc = readNum(buf_, p, '\n', exp)) <= 0)
+                break;
+            // 跳过已经过期的记录
+            if (exp < 0 || exp > now)
+                store_.setWithExpireAtMs(key, val, exp);
+            --remaining_;
+            break;
         }
-        if (line.rfind("ZSET ", 0) != 0)
+        case State::kHashCount:
+            rc = sectionHead("HASH ", State::kHashHead);
+            break;
+        case State::kZSetCount:
+            rc = sectionHead("ZSET ", State::kZSetHead);
+            break;
+        case State::kHashHead:
+        case State::kZSetHead:
         {
-            err = "no zset tag";
-            return false;
+            bool is_hash = state_ == State::kHashHead;
+            if (remaining_ == 0)
+            {
+                state_ = is_hash ? State::kZSetCount : State::kDone;
+                break;
+            }
+            size_t klen = 0;
+            int64_t n = 0;
+            if ((rc = readNum(buf_, p, ' ', klen)) <= 0 || (rc = readBytes(buf_, p, klen, ' ', cur_key_)) <= 0 ||
+                (rc = readNum(buf_, p, ' ', cur_expire_)) <= 0 || (rc = readNum(buf_, p, '\n', n)) <= 0)
+                break;
+            cur_skip_ = cur_expire_ >= 0 && cur_expire_ <= now;
+            --remaining_;
+            // 字段个数暂存在field_left_中, 段内剩余key个数仍由remaining_记录
+            field_left_ = n;
+            state_ = is_hash ? State::kHashField : State::kZSetItem;
+            break;
         }
-        int zset_count = std::stoi(line.substr(5));
-        for (int i = 0; i < zset_count; ++i)
+        case State::kHashField:
+        case State::kZSetItem:
         {
-            if (!readLine(line))
+            bool is_hash = state_ == State::kHashField;
+            if (field_left_ == 0)
             {
-                err = "trunc zset head";
-                return false;
+                if (!cur_skip_ && cur_expire_ >= 0)
+                {
+                    if (is_hash)
+                        store_.setHashExpireAtMs(cur_key_, cur_expire_);
+                    else
+                        store_.setZSetExpireAtMs(cur_key_, cur_expire_);
+                }
+                state_ = is_hash ? State::kHashHead : State::kZSetHead;
+                break;
+            }
+            if (is_hash)
+            {
+                size_t flen = 0, vlen = 0;
+                std::string field, val;
+                if ((rc = readNum(buf_, p, ' ', flen)) <= 0 || (rc = readBytes(buf_, p, flen, ' ', field)) <= 0 ||
+                    (rc = readNum(buf_, p, ' ', vlen)) <= 0 || (rc = readBytes(buf_, p, vlen, '\n', val)) <= 0)
+                    break;
+                if (!cur_skip_)
+                    store_.hset(cur_key_, field, val);
             }
-            size_t p = 0;
-            auto nextTok = [&](std::string &tok) -> bool
-            { size_t s = p; while (s < line.size() && line[s]==' ') ++s; size_t q = line.find(' ', s); if (q == std::string::npos) { tok = line.substr(s); p = line.size(); return true; } tok = line.substr(s, q-s); p = q+1; return true; };
-            std::string klen_s;
-            nextTok(klen_s);
-            int klen = std::stoi(klen_s);
-            std::string key = line.substr(p, static_cast<size_t>(klen));
-            p += static_cast<size_t>(klen) + 1;
-            std::string exp_s;
-            nextTok(exp_s);
-            int64_t exp = std::stoll(exp_s);
-            std::string nitems_s;
-            nextTok(nitems_s);
-            int ni = std::stoi(nitems_s);
-            for (int j = 0; j < ni; ++j)
+            else
             {
-                if (!readLine(line))
+                size_t e = buf_.find(' ', p);
+                if (e == std::string::npos)
                 {
-                    err = "trunc zset item";
-                    return false;
+                    rc = 0;
+                    break;
                 }
-                size_t q = 0;
-                auto nextTok2 = [&](std::string &tok) -> bool
-                { size_t s = q; while (s < line.size() && line[s]==' ') ++s; size_t x = line.find(' ', s); if (x == std::string::npos) { tok = line.substr(s); q = line.size(); return true; } tok = line.substr(s, x-s); q = x+1; return true; };
-                std::string score_s;
-                nextTok2(score_s);
-                double sc = std::stod(score_s);
-                std::string mlen_s;
-                nextTok2(mlen_s);
-                int ml = std::stoi(mlen_s);
-                std::string member = line.substr(q, static_cast<size_t>(ml));
-                store.zadd(key, sc, member);
+                // from_chars对double的支持依赖较新的标准库, 这里沿用strtod
+                std::string score_s = buf_.substr(p, e - p);
+                char *end = nullptr;
+                double sc = std::strtod(score_s.c_str(), &end);
+                if (score_s.empty() || *end != '\0')
+                {
+                    rc = -1;
+                    break;
+                }
+                p = e + 1;
+                size_t mlen = 0;
+                std::string member;
+                if ((rc = readNum(buf_, p, ' ', mlen)) <= 0 || (rc = readBytes(buf_, p, mlen, '\n', member)) <= 0)
+                    break;
+                if (!cur_skip_)
+                    store_.zadd(cur_key_, sc, member);
             }
-            if (exp >= 0)
-                store.setZSetExpireAtMs(key, exp);
+            --field_left_;
+            break;
         }
-        return true;
+        case State::kDone:
+            return 0;
+        }
+        if (rc > 0)
+            pos_ = p;
+        return rc;
     }
 
     std::string Rdb::path() const { return joinPath(opts_.dir, opts_.filename); }
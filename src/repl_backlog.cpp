@@ -0,0 +1,60 @@
+#include "tiny_redis/repl_backlog.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace tiny_redis {
+
+    void ReplBacklog::create(size_t capacity, int64_t offset)
+    {
+        cap_ = capacity > 0 ? capacity : 1;
+        buf_.reset(new char[cap_]);
+        head_ = 0;
+        len_ = 0;
+        end_offset_ = offset;
+    }
+
+    void ReplBacklog::append(const char *data, size_t len)
+    {
+        if (!buf_)
+            return;
+        end_offset_ += static_cast<int64_t>(len);
+        if (len >= cap_)
+        {
+            // 单次写入超过容量, 只需要保留最后cap_个字节
+            std::memcpy(buf_.get(), data + (len - cap_), cap_);
+            head_ = 0;
+            len_ = cap_;
+            return;
+        }
+        // 最多分两段写入: 先写到缓冲区末尾, 剩余部分从头开始覆盖
+        size_t first = std::min(len, cap_ - head_);
+        std::memcpy(buf_.get() + head_, data, first);
+        std::memcpy(buf_.get(), data + first, len - first);
+        head_ = (head_ + len) % cap_;
+        len_ = std::min(cap_, len_ + len);
+    }
+
+    bool ReplBacklog::contains(int64_t offset) const
+    {
+        return buf_ && offset >= startOffset() && offset <= end_offset_;
+    }
+
+    int ReplBacklog::segments(int64_t offset, struct iovec iov[2]) const
+    {
+        if (!contains(offset) || offset == end_offset_)
+            return 0;
+        size_t want = static_cast<size_t>(end_offset_ - offset);
+        // 有效数据在环形缓冲区中的起始位置为 head_ - len_, 所求数据的起始位置为 head_ - want
+        size_t start = (head_ + cap_ - want) % cap_;
+        size_t first = std::min(want, cap_ - start);
+        iov[0].iov_base = buf_.get() + start;
+        iov[0].iov_len = first;
+        if (first == want)
+            return 1;
+        iov[1].iov_base = buf_.get();
+        iov[1].iov_len = want - first;
+        return 2;
+    }
+
+} // namespace tiny_redis
@@ -3,12 +3,22 @@
 #include "tiny_redis/kv.hpp"
 #include "tiny_redis/rdb.hpp"
 #include "tiny_redis/aof.hpp"
+#include "tiny_redis/command.hpp"
+#include "tiny_redis/log.hpp"
 
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <netinet/in.h>
 #include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
 using tiny_redis::g_store;
@@ -38,10 +48,35 @@ namespace tiny_redis {
     }
 
     void ReplicaClient::threadMain()
+    {
+        // 连接断开后按指数退避重连; 成功握手过的连接断开时从最小间隔重新开始
+        int backoff_ms = kMinBackoffMs;
+        while (running_)
+        {
+            bool handshaked = false;
+            int fd = connectMaster();
+            if (fd >= 0)
+            {
+                handshaked = syncWithMaster(fd);
+                ::close(fd);
+            }
+            if (!running_)
+                break;
+            if (handshaked)
+                backoff_ms = kMinBackoffMs;
+            MR_LOG("WARN", (fd >= 0 ? "connection to master lost" : "cannot connect to master")
+                               << ", retry in " << backoff_ms << "ms");
+            for (int waited = 0; waited < backoff_ms && running_; waited += 100)
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            backoff_ms = std::min(backoff_ms * 2, kMaxBackoffMs);
+        }
+    }
+
+    int ReplicaClient::connectMaster()
     {
         int fd = ::socket(AF_INET, SOCK_STREAM, 0);
         if (fd < 0)
-            return;
+            return -1;
         sockaddr_in addr{};
         addr.sin_family = AF_INET;
         addr.sin_port = htons(cfg_.replica.master_port);        // 主节点的监听端口
@@ -51,122 +86,242 @@ namespace tiny_redis {
         if (::connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
         {
             ::close(fd);
-            return;
-        }
-        // send SYNC/PSYNC 同步
-        std::string first;
-        if (last_offset_ > 0)
-        {
-            first = toRespArray({std::string("PSYNC"), std::to_string(last_offset_)});
-        }
-        else
-        {
-            first = toRespArray({std::string("SYNC")});
+            return -1;
         }
-        ::send(fd, first.data(), first.size(), 0);
-        // read RDB bulk 获取主节点传来的数据
+        // 连接建立后切换为非阻塞, 由readSome统一等待可读
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        return fd;
+    }
+
+    bool ReplicaClient::syncWithMaster(int fd)
+    {
+        // 已经从某个主节点同步过时尝试部分重同步, 否则请求全量同步
+        std::string first = master_replid_.empty()
+                                ? toRespArray({std::string("PSYNC"), std::string("?"), std::string("-1")})
+                                : toRespArray({std::string("PSYNC"), master_replid_, std::to_string(last_offset_)});
+        if (::send(fd, first.data(), first.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(first.size()))
+            return false;
+
+        // 主节点的回复:
+        //  +CONTINUE <replid>: 积压缓冲区中仍有所需数据, 之后直接是命令流
+        //  +FULLRESYNC <replid> <offset>: 之后是快照, 然后是从offset开始的命令流
+        // 全量同步的快照有两种格式: `$<len>\r\n<payload>\r\n`, 以及无盘复制的`$EOF:<mark>\r\n<payload><mark>`;
+        // 两种都边接收边交给RdbStreamLoader解析, 既不落盘也不在内存中保存完整的快照
+        enum class SnapState { kReply, kHeader, kBulk, kEof, kDone };
+        SnapState snap = SnapState::kReply;
+        size_t bulk_left = 0;
+        std::string mark;
+        std::string pending;
+        bool loading = false; // 是否收到了快照(部分重同步时没有快照)
+        std::string new_replid;
+        int64_t new_offset = 0;
+        RdbStreamLoader loader(g_store);
         RespParser parser;
-        std::string buf(8192, '\0');
+        std::string buf(256 * 1024, '\0'); // 一次尽量多读, 减少系统调用次数
+        bool handshaked = false;
         while (running_)
         {
-            ssize_t r = ::recv(fd, buf.data(), buf.size(), 0);
-            if (r <= 0)
+            ssize_t r = readSome(fd, buf.data(), buf.size());
+            if (r < 0)
                 break;
-            parser.append(std::string_view(buf.data(), static_cast<size_t>(r)));
-            while (true)
+            if (r == 0)
+                continue;
+            std::string_view chunk(buf.data(), static_cast<size_t>(r));
+            if (snap != SnapState::kDone)
             {
-                auto v = parser.tryParseOne();
-                if (!v.has_value())
-                    break;
-                if (v->type == RespType::kBulkString)
-                {
-                    // treat as RDB content; parse with Rdb::load by writing temp and reading
-                    // For simplicity, reuse Rdb by writing to file and calling load
-                    RdbOptions ropts = cfg_.rdb;
-                    if (!ropts.enabled)
-                        ropts.enabled = true;
-                    Rdb r(ropts);
-                    std::string path = r.path();
-                    FILE *f = ::fopen(path.c_str(), "wb");
-                    if (!f)
-                    {
-                        int err = errno; // 保存 errno 的值，因为后续的函数调用可能会修改它
-                        std::cerr << "Error: Failed to open RDB file at path: '" << path << "'. "
-                                  << "Reason: " << strerror(err) << " (errno=" << err << ")" << std::endl;
-
-                        return;
-                    }
-                    fwrite(v->bulk.data(), 1, v->bulk.size(), f);
-                    fclose(f);
-                    std::string err;
-                    r.load(g_store, err);
-                }
-                else if (v->type == RespType::kArray)
+                pending.append(chunk);
+                chunk = std::string_view();
+                std::string err;
+                bool failed = false;
+                while (snap != SnapState::kDone && !failed)
                 {
-                    // command array
-                    if (v->array.empty())
-                        continue;
-                    std::string cmd;
-                    for (char c : v->array[0].bulk)
-                        cmd.push_back(static_cast<char>(::toupper(c)));
-                    if (cmd == "SET" && v->array.size() == 3)
-                    {
-                        g_store.set(v->array[1].bulk, v->array[2].bulk);
-                    }
-                    else if (cmd == "DEL" && v->array.size() >= 2)
-                    {
-                        std::vector<std::string> keys;
-                        for (size_t i = 1; i < v->array.size(); ++i)
-                            keys.emplace_back(v->array[i].bulk);
-                        g_store.del(keys);
-                    }
-                    else if (cmd == "EXPIRE" && v->array.size() == 3)
+                    if (snap == SnapState::kReply)
                     {
-                        int64_t s = std::stoll(v->array[2].bulk);
-                        g_store.expire(v->array[1].bulk, s);
+                        size_t e = pending.find("\r\n");
+                        if (e == std::string::npos)
+                            break;
+                        std::string line = pending.substr(0, e);
+                        pending.erase(0, e + 2);
+                        char id[64] = {0};
+                        long long off = 0;
+                        if (line.rfind("+CONTINUE", 0) == 0)
+                        {
+                            MR_LOG("INFO", "partial resync from offset " << last_offset_);
+                            snap = SnapState::kDone;
+                        }
+                        else if (std::sscanf(line.c_str(), "+FULLRESYNC %40s %lld", id, &off) == 2)
+                        {
+                            MR_LOG("INFO", "full resync with master " << id << " from offset " << off);
+                            new_replid = id;
+                            new_offset = off;
+                            snap = SnapState::kHeader;
+                        }
+                        else
+                        {
+                            failed = true;
+                            err = "unexpected PSYNC reply: " + line;
+                        }
                     }
-                    else if (cmd == "HSET" && v->array.size() == 4)
+                    else if (snap == SnapState::kHeader)
                     {
-                        g_store.hset(v->array[1].bulk, v->array[2].bulk, v->array[3].bulk);
+                        size_t e = pending.find("\r\n");
+                        if (e == std::string::npos)
+                            break;
+                        if (pending.compare(0, 5, "$EOF:") == 0)
+                        {
+                            mark = pending.substr(5, e - 5);
+                            snap = SnapState::kEof;
+                        }
+                        else if (pending[0] == '$')
+                        {
+                            bulk_left = static_cast<size_t>(std::strtoull(pending.c_str() + 1, nullptr, 10));
+                            snap = SnapState::kBulk;
+                        }
+                        else
+                        {
+                            failed = true;
+                            err = "bad snapshot header";
+                            break;
+                        }
+                        pending.erase(0, e + 2);
+                        loading = true;
+                        // 数据集清空后, 旧的复制ID与偏移量不再有效, 快照加载完成前断开必须重新全量同步
+                        master_replid_.clear();
+                        g_store.clear();
                     }
-                    else if (cmd == "HDEL" && v->array.size() >= 3)
+                    else if (snap == SnapState::kBulk)
                     {
-                        std::vector<std::string> fs;
-                        for (size_t i = 2; i < v->array.size(); ++i)
-                            fs.emplace_back(v->array[i].bulk);
-                        g_store.hdel(v->array[1].bulk, fs);
+                        size_t n = std::min(bulk_left, pending.size());
+                        failed = !loader.feed(pending.data(), n, err);
+                        pending.erase(0, n);
+                        bulk_left -= n;
+                        if (bulk_left > 0 || pending.size() < 2)
+                            break;
+                        pending.erase(0, 2); // bulk string末尾的\r\n
+                        snap = SnapState::kDone;
                     }
-                    else if (cmd == "ZADD" && v->array.size() == 4)
+                    else
                     {
-                        double sc = std::stod(v->array[2].bulk);
-                        g_store.zadd(v->array[1].bulk, sc, v->array[3].bulk);
+                        // 结束标记可能跨越两次recv, 末尾不足一个标记长度的数据留到下次再判断
+                        size_t pos = pending.find(mark);
+                        size_t n = pos != std::string::npos ? pos
+                                   : (pending.size() >= mark.size() ? pending.size() - mark.size() + 1 : 0);
+                        failed = !loader.feed(pending.data(), n, err);
+                        pending.erase(0, pos != std::string::npos ? pos + mark.size() : n);
+                        if (pos == std::string::npos)
+                            break;
+                        snap = SnapState::kDone;
                     }
-                    else if (cmd == "ZREM" && v->array.size() >= 3)
+                }
+                if (!failed && snap == SnapState::kDone && loading && !loader.done())
+                {
+                    failed = true;
+                    err = "truncated snapshot";
+                }
+                if (failed)
+                {
+                    MR_LOG("ERROR", "failed to sync with master: " << err);
+                    break;
+                }
+                if (snap != SnapState::kDone)
+                    continue;
+                if (loading)
+                {
+                    master_replid_ = new_replid;
+                    last_offset_ = new_offset;
+                }
+                handshaked = true;
+                // 快照之后的数据是命令流
+                parser.append(pending);
+                pending.clear();
+                pending.shrink_to_fit();
+            }
+            else
+            {
+                parser.append(chunk);
+            }
+            if (!applyStream(parser))
+            {
+                MR_LOG("ERROR", "protocol error in replication stream");
+                break;
+            }
+        }
+        return handshaked;
+    }
+
+    ssize_t ReplicaClient::readSome(int fd, char *buf, size_t cap)
+    {
+        pollfd p{fd, POLLIN, 0};
+        int rc = ::poll(&p, 1, 100);
+        if (rc < 0)
+            return errno == EINTR ? 0 : -1;
+        if (rc == 0)
+            return 0;
+        ssize_t r = ::recv(fd, buf, cap, 0);
+        if (r > 0)
+            return r;
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return 0;
+        return -1;
+    }
+
+    bool ReplicaClient::applyStream(RespParser &parser)
+    {
+        // 每次加锁最多应用的命令数, 避免长时间占用store锁而阻塞事件循环处理读请求
+        constexpr size_t kMaxBatch = 1024;
+        std::vector<std::string_view> argv;
+        std::string_view raw;
+        int rc = 1;
+        while (rc > 0)
+        {
+            size_t n = 0;
+            g_store.withLock([&]
+                             {
+                while (n < kMaxBatch && (rc = parser.parseCommand(argv, raw)) > 0)
+                {
+                    ++n;
+                    if (raw[0] == '*')
                     {
-                        std::vector<std::string> ms;
-                        for (size_t i = 2; i < v->array.size(); ++i)
-                            ms.emplace_back(v->array[i].bulk);
-                        g_store.zrem(v->array[1].bulk, ms);
+                        applyCommand(argv, raw);
+                        // 偏移量只统计命令流本身, 与主节点的master_repl_offset一致
+                        last_offset_ += static_cast<int64_t>(raw.size());
                     }
-                    else if (v->type == RespType::kSimpleString)
+                    else if (raw[0] == '+' && argv[0].rfind("OFFSET ", 0) == 0)
                     {
-                        // parse +OFFSET <num>
-                        const std::string &s = v->bulk;
-                        if (s.rfind("OFFSET ", 0) == 0)
-                        {
-                            try
-                            {
-                                last_offset_ = std::stoll(s.substr(8));
-                            }
-                            catch (...)
-                            {
-                            }
-                        }
+                        // +OFFSET <num>: 之后的命令流从该偏移量开始
+                        int64_t off = 0;
+                        auto sv = argv[0].substr(7);
+                        auto res = std::from_chars(sv.data(), sv.data() + sv.size(), off);
+                        if (res.ec == std::errc())
+                            last_offset_ = off;
                     }
-                }
-            }
+                } });
+            if (n < kMaxBatch)
+                break;
+        }
+        return rc >= 0;
+    }
+
+    void ReplicaClient::applyCommand(const std::vector<std::string_view> &argv, std::string_view raw)
+    {
+        if (argv.empty())
+            return;
+        const Command *cmd = g_commands.lookup(argv[0]);
+        // 主节点的命令流中除了写命令只有PING之类的心跳, 不需要执行
+        if (!cmd || !(cmd->flags & kCmdWrite))
+            return;
+        // 复用scratch_中已有的字符串容量, 稳定运行后不再分配内存
+        scratch_.type = RespType::kArray;
+        scratch_.array.resize(argv.size());
+        for (size_t i = 0; i < argv.size(); ++i)
+        {
+            scratch_.array[i].type = RespType::kBulkString;
+            scratch_.array[i].bulk.assign(argv[i].data(), argv[i].size());
         }
-        ::close(fd);
+        CommandContext ctx;
+        ctx.raw = raw;
+        ctx.propagate = false;
+        cmd->proc(scratch_, ctx);
     }
 
 }  // namespace tiny_redis
@@ -1,10 +1,18 @@
 #include "tiny_redis/resp.hpp"
+
+#include <cstring>
 #include <charconv>
 
 namespace tiny_redis {
 
     void RespParser::append(std::string_view data)
     {
+        // 已解析的部分在追加新数据前一次性移除, 避免每解析一条命令就移动一次缓冲区
+        if (consumed_ > 0)
+        {
+            buffer_.erase(0, consumed_);
+            consumed_ = 0;
+        }
         buffer_.append(data.data(), data.size());
     }
 
@@ -135,9 +143,10 @@ namespace tiny_redis {
 
     std::optional<RespValue> RespParser::tryParseOne()
     {
-        if (buffer_.empty())
+        if (consumed_ >= buffer_.size())
             return std::nullopt;
-        size_t pos = 0;
+        const size_t start = consumed_;
+        size_t pos = start;
         char prefix = buffer_[pos++];
         RespValue out;
         bool ok = false;
@@ -171,15 +180,16 @@ namespace tiny_redis {
         }
         if (!ok)
             return std::nullopt;
-        buffer_.erase(0, pos);
+        consumed_ = pos;
         return out;
     }
 
     std::optional<std::pair<RespValue, std::string>> RespParser::tryParseOneWithRaw()
     {
-        if (buffer_.empty())
+        if (consumed_ >= buffer_.size())
             return std::nullopt;
-        size_t pos = 0;
+        const size_t start = consumed_;
+        size_t pos = start;
         char prefix = buffer_[pos++];
         RespValue out;
         bool ok = false;
@@ -213,11 +223,81 @@ namespace tiny_redis {
         }
         if (!ok)
             return std::nullopt;
-        std::string raw(buffer_.data(), pos);
-        buffer_.erase(0, pos);
+        std::string raw(buffer_.data() + start, pos - start);
+        consumed_ = pos;
         return std::make_pair(std::move(out), std::move(raw));
     }
 
+    int RespParser::parseCommand(std::vector<std::string_view> &argv, std::string_view &raw)
+    {
+        argv.clear();
+        if (consumed_ >= buffer_.size())
+            return 0;
+        const char *base = buffer_.data();
+        const size_t size = buffer_.size();
+        size_t pos = consumed_;
+        // 读取一行并返回其内容(不含\r\n), 不完整时返回false
+        auto line = [&](std::string_view &out) -> bool
+        {
+            const void *cr = std::memchr(base + pos, '\r', size - pos);
+            if (!cr)
+                return false;
+            size_t e = static_cast<size_t>(static_cast<const char *>(cr) - base);
+            if (e + 1 >= size)
+                return false;
+            out = std::string_view(base + pos, e - pos);
+            pos = e + 2;
+            return true;
+        };
+        auto number = [](std::string_view sv, int64_t &out) -> bool
+        {
+            auto [ptr, ec] = std::from_chars(sv.data(), sv.data() + sv.size(), out);
+            return ec == std::errc() && ptr == sv.data() + sv.size();
+        };
+        char prefix = base[pos++];
+        std::string_view ln;
+        if (prefix == '+' || prefix == '-' || prefix == ':')
+        {
+            if (!line(ln))
+                return 0;
+            argv.push_back(ln);
+        }
+        else if (prefix == '*')
+        {
+            int64_t count = 0;
+            if (!line(ln))
+                return 0;
+            if (!number(ln, count) || count < 0)
+                return -1;
+            argv.reserve(static_cast<size_t>(count));
+            for (int64_t i = 0; i < count; ++i)
+            {
+                if (pos >= size)
+                    return 0;
+                if (base[pos++] != '$')
+                    return -1;
+                int64_t len = 0;
+                if (!line(ln))
+                    return 0;
+                if (!number(ln, len) || len < 0)
+                    return -1;
+                if (size - pos < static_cast<size_t>(len) + 2)
+                    return 0;
+                if (base[pos + static_cast<size_t>(len)] != '\r' || base[pos + static_cast<size_t>(len) + 1] != '\n')
+                    return -1;
+                argv.emplace_back(base + pos, static_cast<size_t>(len));
+                pos += static_cast<size_t>(len) + 2;
+            }
+        }
+        else
+        {
+            return -1;
+        }
+        raw = std::string_view(base + consumed_, pos - consumed_);
+        consumed_ = pos;
+        return 1;
+    }
+
     std::string respSimpleString(std::string_view s) { return std::string("+") + std::string(s) + "\r\n"; }
     std::string respError(std::string_view s) { return std::string("-") + std::string(s) + "\r\n"; }
     std::string respBulk(std::string_view s)
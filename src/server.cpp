@@ -7,6 +7,9 @@
 #include "tiny_redis/aof.hpp"
 #include "tiny_redis/rdb.hpp"
 #include "tiny_redis/replica_client.hpp"
+#include "tiny_redis/glob.hpp"
+#include "tiny_redis/repl_backlog.hpp"
+#include "tiny_redis/command.hpp"
 
 #include <arpa/inet.h>
 #include <errno.h>
@@ -15,10 +18,17 @@
 #include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <poll.h>
 #include <netinet/tcp.h>
 #include <sys/uio.h>
 #include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
+#include <algorithm>
 #include <cstring>
 #include <cctype>
 #include <iostream>
@@ -27,6 +37,10 @@
 #include <unordered_map>
 #include <vector>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
 
 namespace tiny_redis
 {
@@ -62,15 +76,27 @@ namespace tiny_redis
             return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
         }
 
+        // @brief 待发送的输出块: 普通回复独占一个字符串, 复制流则由所有从节点共享同一份只读缓冲区
+        struct OutChunk
+        {
+            std::string owned;
+            std::shared_ptr<const std::string> shared;
+
+            const std::string &str() const { return shared ? *shared : owned; }
+        };
+
         struct Conn
         {
             int fd = -1;
             std::string in = "";
-            std::vector<std::string> out_chunks = {}; // 待发送块队列
+            std::vector<OutChunk> out_chunks = {}; // 待发送块队列
             size_t out_iov_idx = 0;                   // 当前发送到第几个块
             size_t out_offset = 0;                    // 当前块内偏移
             RespParser parser = {};
             bool is_replica = false;
+            // PSYNC续传: 积压缓冲区中下一个待发送的偏移量, -1表示没有在续传; 续传期间命令流不进入输出队列
+            int64_t backlog_off = -1;
+            bool repl_transfer = false; // 正在由后台线程发送无盘复制的快照, 此时事件循环不能写该socket
         };
 
     } // namespace
@@ -123,6 +149,8 @@ namespace tiny_redis
         return 0;
     }
 
+    static int g_transfer_event_fd = -1; // 无盘复制完成通知
+
     int Server::setupEpoll()
     {
         epoll_fd_ = epoll_create1(0);
@@ -157,6 +185,13 @@ namespace tiny_redis
             std::perror("epoll_ctl add timer");
             return -1;
         }
+        // 无盘复制的后台线程通过eventfd通知事件循环快照已发送完毕
+        g_transfer_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (g_transfer_event_fd < 0 || add_epoll(epoll_fd_, g_transfer_event_fd, EPOLLIN | EPOLLET) < 0)
+        {
+            std::perror("eventfd");
+            return -1;
+        }
         return 0;
     }
 
@@ -166,12 +201,17 @@ namespace tiny_redis
     static std::vector<std::vector<std::string>> g_repl_queue;
     static inline bool has_pending(const Conn &c)
     {
-        return c.out_iov_idx < c.out_chunks.size() || (c.out_iov_idx == c.out_chunks.size() && c.out_offset != 0);
+        return c.out_iov_idx < c.out_chunks.size() || (c.out_iov_idx == c.out_chunks.size() && c.out_offset != 0) ||
+               c.backlog_off >= 0;
     }
 
+    static void flushBacklog(int fd, Conn &c, uint32_t &ev);
+
     // Try to flush pending output immediately without waiting for EPOLLOUT.
     static void try_flush_now(int fd, Conn &c, uint32_t &ev)
     {
+        if (c.repl_transfer)
+            return;
         while (has_pending(c))
         {
             const size_t max_iov = 64;
@@ -181,7 +221,7 @@ namespace tiny_redis
             size_t off = c.out_offset;
             while (idx < c.out_chunks.size() && iovcnt < (int)max_iov)
             {
-                const std::string &s = c.out_chunks[idx];
+                const std::string &s = c.out_chunks[idx].str();
                 const char *base = s.data();
                 size_t len = s.size();
                 if (off >= len)
@@ -204,7 +244,7 @@ namespace tiny_redis
                 size_t rem = (size_t)w;
                 while (rem > 0 && c.out_iov_idx < c.out_chunks.size())
                 {
-                    std::string &s = c.out_chunks[c.out_iov_idx];
+                    const std::string &s = c.out_chunks[c.out_iov_idx].str();
                     size_t avail = s.size() - c.out_offset;
                     if (rem < avail)
                     {
@@ -237,609 +277,921 @@ namespace tiny_redis
                 break;
             }
         }
+        // PSYNC续传: 输出队列发完之后再直接从积压缓冲区发送
+        if (c.backlog_off >= 0 && c.out_chunks.empty() && !(ev & EPOLLRDHUP))
+            flushBacklog(fd, c, ev);
     }
 
     static inline void enqueue_out(Conn &c, std::string s)
     {
         if (!s.empty())
-            c.out_chunks.emplace_back(std::move(s));
+            c.out_chunks.push_back(OutChunk{std::move(s), nullptr});
+    }
+
+    // @brief 把共享缓冲区加入输出队列, 只增加引用计数而不拷贝数据
+    static inline void enqueue_shared(Conn &c, const std::shared_ptr<const std::string> &buf)
+    {
+        if (buf && !buf->empty())
+            c.out_chunks.push_back(OutChunk{std::string(), buf});
     }
 
-    static std::string g_repl_backlog;
-    static const size_t kReplBacklogCap = 4 * 1024 * 1024; // 4MB
-    static int64_t g_repl_offset = 0;                      // total bytes produced
-    static int64_t g_backlog_start_offset = 0;             // offset of first byte in backlog buffer
+    static ReplBacklog g_backlog;
+    static int64_t g_repl_offset = 0; // total bytes produced
+    static std::string g_replid;      // 本次运行的复制ID, 与偏移量一起唯一确定一段复制历史
+    static const ServerConfig *g_config = nullptr;
 
-    static void appendToBacklog(const std::string &data)
+    // @brief 第一个从节点连接时才创建积压缓冲区
+    static void ensureBacklog()
     {
-        if (g_repl_backlog.size() + data.size() <= kReplBacklogCap)
-        {
-            g_repl_backlog.append(data);
-        }
-        else
+        if (!g_backlog.active())
+            g_backlog.create(g_config->repl.backlog_size, g_repl_offset);
+    }
+
+    /**
+     * @brief PSYNC命中积压缓冲区时补发offset之后的数据
+     * @note 只记录续传位置, 数据由flushBacklog在socket可写时直接从环形缓冲区分段writev, 不拷贝;
+     * 续传期间新产生的命令流同样先写入积压缓冲区, 因此追上endOffset之后再切换回共享输出队列
+     */
+    static void sendBacklogFrom(Conn &c, int64_t offset)
+    {
+        c.backlog_off = offset < g_backlog.endOffset() ? offset : -1;
+    }
+
+    /**
+     * @brief 从积压缓冲区续传, 直到追上末尾或socket写满
+     * @note 从节点太慢, 未发送的数据已被覆盖时断开连接, 由从节点重新发起全量同步
+     */
+    static void flushBacklog(int fd, Conn &c, uint32_t &ev)
+    {
+        while (c.backlog_off >= 0)
         {
-            size_t need = data.size();
-            if (need >= kReplBacklogCap)
+            if (!g_backlog.contains(c.backlog_off))
             {
-                g_repl_backlog.assign(data.data() + (need - kReplBacklogCap), kReplBacklogCap);
+                c.backlog_off = -1;
+                ev |= EPOLLRDHUP;
+                return;
             }
-            else
+            struct iovec iov[2];
+            int n = g_backlog.segments(c.backlog_off, iov);
+            if (n == 0)
             {
-                size_t drop = (g_repl_backlog.size() + need) - kReplBacklogCap;
-                g_repl_backlog.erase(0, drop);
-                g_repl_backlog.append(data);
+                c.backlog_off = -1;
+                return;
             }
+            ssize_t w = ::writev(fd, iov, n);
+            if (w > 0)
+            {
+                c.backlog_off += w;
+                continue;
+            }
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return;
+            std::perror("writev");
+            c.backlog_off = -1;
+            ev |= EPOLLRDHUP;
+            return;
         }
-        // update start offset after appending
-        g_backlog_start_offset = g_repl_offset - static_cast<int64_t>(g_repl_backlog.size());
     }
 
-    static std::string handle_command(const RespValue &v, const std::string *raw)
+    // 无盘复制: 后台线程等到子进程发送完快照后把(fd, 是否成功)放入完成队列, 并通过g_transfer_event_fd唤醒事件循环
+    static std::mutex g_transfer_mu;
+    static std::vector<std::pair<int, bool>> g_transfer_done;
+    static std::unordered_map<int, std::thread> g_transfer_threads;
+
+    // @brief 生成40个十六进制字符的随机串, 用作复制ID以及无盘复制的结束标记
+    static std::string randomHexId()
     {
-        if (v.type != RespType::kArray || v.array.empty())
-            return respError("ERR protocol error");
-        const auto &head = v.array[0];
-        if (head.type != RespType::kBulkString && head.type != RespType::kSimpleString)
-            return respError("ERR wrong type");
-        std::string cmd;
-        cmd.reserve(head.bulk.size());
-        for (char c : head.bulk)
-            cmd.push_back(static_cast<char>(::toupper(c)));
-
-        if (cmd == "PING")
-        {
-            if (v.array.size() <= 1)
-                return respSimpleString("PONG");
-            if (v.array.size() == 2 && v.array[1].type == RespType::kBulkString)
-                return respBulk(v.array[1].bulk);
-            return respError("ERR wrong number of arguments for 'PING'");
-        }
-        if (cmd == "ECHO")
-        {
-            if (v.array.size() == 2 && v.array[1].type == RespType::kBulkString)
-                return respBulk(v.array[1].bulk);
-            return respError("ERR wrong number of arguments for 'ECHO'");
-        }
-        if (cmd == "SET")
+        static std::mt19937_64 rng(std::random_device{}());
+        static const char hex[] = "0123456789abcdef";
+        std::string mark(40, '0');
+        for (auto &ch : mark)
+            ch = hex[rng() & 0xf];
+        return mark;
+    }
+
+    /**
+     * @brief 在子进程中把数据集直接写到从节点的socket: `<head>$EOF:<mark>\r\n<payload><mark>`
+     * @param head 快照之前的回复(PSYNC的+FULLRESYNC), 与快照一并写出以保证顺序
+     * @return 全部发送成功返回true
+     * @note 运行在forkSnapshot的子进程中, 不能使用日志
+     */
+    static bool sendSnapshot(int fd, std::string head, const std::string &mark)
+    {
+        auto sendAll = [fd](const char *data, size_t len) -> bool
         {
-            if (v.array.size() < 3)
-                return respError("ERR wrong number of arguments for 'SET'");
-            if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString)
-                return respError("ERR syntax");
-            std::optional<int64_t> ttl_ms;
-            // minimal options support: EX seconds or PX milliseconds
-            size_t i = 3;
-            while (i < v.array.size())
+            while (len > 0)
             {
-                if (v.array[i].type != RespType::kBulkString)
-                    return respError("ERR syntax");
-                std::string opt;
-                opt.reserve(v.array[i].bulk.size());
-                for (char ch : v.array[i].bulk)
-                    opt.push_back(static_cast<char>(::toupper(ch)));
-                if (opt == "EX")
+                ssize_t w = ::send(fd, data, len, MSG_NOSIGNAL);
+                if (w > 0)
                 {
-                    if (i + 1 >= v.array.size() || v.array[i + 1].type != RespType::kBulkString)
-                        return respError("ERR syntax");
-                    try
-                    {
-                        int64_t sec = std::stoll(v.array[i + 1].bulk);
-                        if (sec < 0)
-                            return respError("ERR invalid expire time in SET");
-                        ttl_ms = sec * 1000;
-                    }
-                    catch (...)
-                    {
-                        return respError("ERR value is not an integer or out of range");
-                    }
-                    i += 2;
+                    data += w;
+                    len -= static_cast<size_t>(w);
                     continue;
                 }
-                else if (opt == "PX")
-                {
-                    if (i + 1 >= v.array.size() || v.array[i + 1].type != RespType::kBulkString)
-                        return respError("ERR syntax");
-                    try
-                    {
-                        int64_t ms = std::stoll(v.array[i + 1].bulk);
-                        if (ms < 0)
-                            return respError("ERR invalid expire time in SET");
-                        ttl_ms = ms;
-                    }
-                    catch (...)
-                    {
-                        return respError("ERR value is not an integer or out of range");
-                    }
-                    i += 2;
+                if (w < 0 && errno == EINTR)
                     continue;
-                }
-                else
+                if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
                 {
-                    // unsupported option for now
-                    return respError("ERR syntax");
+                    // socket是非阻塞的, 等待可写; 长时间不可写视为从节点已失效
+                    pollfd p{fd, POLLOUT, 0};
+                    if (::poll(&p, 1, 60 * 1000) <= 0 || (p.revents & (POLLERR | POLLHUP)))
+                        return false;
+                    continue;
                 }
+                return false;
             }
-            g_store.set(v.array[1].bulk, v.array[2].bulk, ttl_ms);
-            if (raw)
-                g_aof.appendRaw(*raw);
-            else
-            {
-                std::vector<std::string> parts;
-                parts.reserve(v.array.size());
-                for (const auto &e : v.array)
-                    parts.push_back(e.bulk);
-                g_aof.appendCommand(parts);
-            }
-            // replicate original args
+            return true;
+        };
+        head += "$EOF:" + mark + "\r\n";
+        std::string err;
+        return sendAll(head.data(), head.size()) &&
+               Rdb::writeSnapshot(g_store, sendAll, err) &&
+               sendAll(mark.data(), mark.size());
+    }
+
+    // @brief 后台线程: 等待发送快照的子进程退出, 然后通知事件循环
+    static void waitTransfer(int fd, pid_t pid)
+    {
+        int status = 0;
+        while (::waitpid(pid, &status, 0) < 0)
+        {
+            if (errno != EINTR)
             {
-                std::vector<std::string> parts;
-                parts.reserve(v.array.size());
-                for (const auto &e : v.array)
-                    parts.push_back(e.bulk);
-                g_repl_queue.push_back(std::move(parts));
+                status = -1;
+                break;
             }
-            return respSimpleString("OK");
         }
-        if (cmd == "GET")
         {
-            if (v.array.size() != 2)
-                return respError("ERR wrong number of arguments for 'GET'");
-            if (v.array[1].type != RespType::kBulkString)
-                return respError("ERR syntax");
-            auto val = g_store.get(v.array[1].bulk);
-            if (!val.has_value())
-                return respNullBulk();
-            return respBulk(*val);
+            std::lock_guard<std::mutex> lk(g_transfer_mu);
+            g_transfer_done.emplace_back(fd, status == 0);
         }
-        if (cmd == "KEYS")
+        uint64_t one = 1;
+        ssize_t _w = ::write(g_transfer_event_fd, &one, sizeof(one));
+        (void)_w;
+    }
+
+    /**
+     * @brief 开始一次无盘全量同步: fork出的子进程发送fork那一刻的数据集, 后台线程等待子进程退出后通知事件循环
+     * @param head 快照之前的回复(PSYNC的+FULLRESYNC), 为空表示没有
+     * @return fork失败返回false
+     * @note 事件循环在fork的同时读取复制偏移量, 快照与之后补发的命令流恰好衔接, 每条命令在从节点上只执行一次;
+     * 子进程与父进程写时复制共享内存, 不需要拷贝数据集
+     */
+    static bool startDisklessTransfer(int fd, std::string head)
+    {
+        std::string mark = randomHexId();
+        pid_t pid = g_store.forkSnapshot();
+        if (pid == 0)
+            ::_exit(sendSnapshot(fd, std::move(head), mark) ? 0 : 1);
+        if (pid < 0)
+            return false;
+        g_transfer_threads.emplace(fd, std::thread(waitTransfer, fd, pid));
+        return true;
+    }
+
+    static bool g_defrag_running = false; // 当前是否处于主动碎片整理状态
+
+    // @brief 堆内空闲字节占已使用字节的百分比, 无法获取分配器统计时返回-1
+    static int heapFragmentationPct()
+    {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+        struct mallinfo2 mi = ::mallinfo2();
+        if (mi.uordblks == 0)
+            return 0;
+        return static_cast<int>(mi.fordblks * 100 / mi.uordblks);
+#else
+        return -1;
+#endif
+    }
+
+    // @brief SCAN/HSCAN/ZSCAN的可选参数
+    struct ScanOptions
+    {
+        std::string pattern; // MATCH, 为空表示不过滤
+        size_t count = 10;   // COUNT
+        std::string type;    // TYPE, 仅SCAN支持
+    };
+
+    // @brief 解析游标以及从start开始的MATCH/COUNT/TYPE选项, 出错时返回错误回复
+    static std::optional<std::string> parseScanArgs(const RespValue &v, size_t start, bool allow_type,
+                                                    uint64_t &cursor, ScanOptions &opts)
+    {
+        try
         {
-            // 允许 KEYS 或 KEYS <pattern>，未带 pattern 时等价 '*'
-            std::string pattern = "*";
-            if (v.array.size() == 2)
+            size_t idx = 0;
+            cursor = std::stoull(v.array[start - 1].bulk, &idx);
+            if (idx != v.array[start - 1].bulk.size())
+                return respError("ERR invalid cursor");
+        }
+        catch (...)
+        {
+            return respError("ERR invalid cursor");
+        }
+        for (size_t i = start; i < v.array.size(); i += 2)
+        {
+            if (i + 1 >= v.array.size())
+                return respError("ERR syntax error");
+            std::string opt;
+            for (char ch : v.array[i].bulk)
+                opt.push_back(static_cast<char>(::toupper(ch)));
+            const std::string &arg = v.array[i + 1].bulk;
+            if (opt == "MATCH")
             {
-                if (v.array[1].type == RespType::kBulkString || v.array[1].type == RespType::kSimpleString)
+                opts.pattern = arg == "*" ? std::string() : arg;
+            }
+            else if (opt == "COUNT")
+            {
+                try
                 {
-                    pattern = v.array[1].bulk;
+                    long long n = std::stoll(arg);
+                    if (n < 1)
+                        return respError("ERR syntax error");
+                    opts.count = static_cast<size_t>(n);
                 }
-                else
+                catch (...)
                 {
-                    return respError("ERR syntax");
+                    return respError("ERR value is not an integer or out of range");
                 }
             }
-            else if (v.array.size() != 1)
+            else if (opt == "TYPE" && allow_type)
             {
-                return respError("ERR wrong number of arguments for 'KEYS'");
+                opts.type.clear();
+                for (char ch : arg)
+                    opts.type.push_back(static_cast<char>(::tolower(ch)));
             }
-            // 仅支持 '*' 通配（返回所有 keys）。复杂模式可后续扩展。
-            auto keys = g_store.listKeys();
-            if (pattern != "*")
+            else
             {
-                // 简易实现：不支持复杂 glob，直接返回空，或可实现简单前缀/后缀匹配
-                // 这里先实现 '*'；其它模式后续扩展
-                keys.clear();
+                return respError("ERR syntax error");
             }
-            std::string out = "*" + std::to_string(keys.size()) + "\r\n";
-            for (const auto &k : keys)
-                out += respBulk(k);
-            return out;
         }
-        if (cmd == "FLUSHALL")
+        return std::nullopt;
+    }
+
+    // @brief 组装SCAN系列命令的回复: [cursor, [elements...]]
+    static std::string scanReply(uint64_t cursor, const std::vector<std::string> &elems)
+    {
+        std::string out = "*2\r\n" + respBulk(std::to_string(cursor));
+        out += "*" + std::to_string(elems.size()) + "\r\n";
+        for (const auto &e : elems)
+            out += respBulk(e);
+        return out;
+    }
+
+    // @brief 把写命令加入本轮的复制队列; 从节点应用主节点的命令流时不再向下传播
+    static void replicate(const CommandContext &ctx, std::vector<std::string> parts)
+    {
+        if (ctx.propagate)
+            g_repl_queue.push_back(std::move(parts));
+    }
+
+    static std::string cmdPing(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() <= 1)
+            return respSimpleString("PONG");
+        if (v.array.size() == 2 && v.array[1].type == RespType::kBulkString)
+            return respBulk(v.array[1].bulk);
+        return respError("ERR wrong number of arguments for 'PING'");
+    }
+
+    static std::string cmdEcho(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() == 2 && v.array[1].type == RespType::kBulkString)
+            return respBulk(v.array[1].bulk);
+        return respError("ERR wrong number of arguments for 'ECHO'");
+    }
+
+    static std::string cmdSet(const RespValue &v, CommandContext &ctx)
+    {
+        if (v.array.size() < 3)
+            return respError("ERR wrong number of arguments for 'SET'");
+        if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString)
+            return respError("ERR syntax");
+        std::optional<int64_t> ttl_ms;
+        // minimal options support: EX seconds or PX milliseconds
+        size_t i = 3;
+        while (i < v.array.size())
         {
-            if (v.array.size() != 1)
-                return respError("ERR wrong number of arguments for 'FLUSHALL'");
-            // 清空所有数据结构
-            {
-                // 直接使用快照删除，更安全的是在 KV 层提供 clear 接口
-                auto s1 = g_store.snapshot();
-                std::vector<std::string> keys;
-                keys.reserve(s1.size());
-                for (const auto &kvp : s1)
-                    keys.push_back(kvp.first);
-                g_store.del(keys);
-            }
+            if (v.array[i].type != RespType::kBulkString)
+                return respError("ERR syntax");
+            std::string opt;
+            opt.reserve(v.array[i].bulk.size());
+            for (char ch : v.array[i].bulk)
+                opt.push_back(static_cast<char>(::toupper(ch)));
+            if (opt == "EX")
             {
-                auto s2 = g_store.snapshotHash();
-                for (const auto &kvp : s2)
+                if (i + 1 >= v.array.size() || v.array[i + 1].type != RespType::kBulkString)
+                    return respError("ERR syntax");
+                try
                 {
-                    std::vector<std::string> flds;
-                    for (const auto &fv : kvp.second.fields)
-                        flds.push_back(fv.first);
-                    g_store.hdel(kvp.first, flds);
+                    int64_t sec = std::stoll(v.array[i + 1].bulk);
+                    if (sec < 0)
+                        return respError("ERR invalid expire time in SET");
+                    ttl_ms = sec * 1000;
                 }
-            }
-            {
-                auto s3 = g_store.snapshotZSet();
-                for (const auto &flat : s3)
+                catch (...)
                 {
-                    std::vector<std::string> mems;
-                    mems.reserve(flat.items.size());
-                    for (const auto &it : flat.items)
-                        mems.push_back(it.second);
-                    g_store.zrem(flat.key, mems);
+                    return respError("ERR value is not an integer or out of range");
                 }
+                i += 2;
+                continue;
             }
-            // AOF 记录
-            if (raw)
-                g_aof.appendRaw(*raw);
-            else
-                g_aof.appendCommand({"FLUSHALL"});
-            // 复制广播
-            g_repl_queue.push_back({"FLUSHALL"});
-            return respSimpleString("OK");
-        }
-        if (cmd == "DEL")
-        {
-            if (v.array.size() < 2)
-                return respError("ERR wrong number of arguments for 'DEL'");
-            std::vector<std::string> keys;
-            keys.reserve(v.array.size() - 1);
-            for (size_t i = 1; i < v.array.size(); ++i)
+            else if (opt == "PX")
             {
-                if (v.array[i].type != RespType::kBulkString)
+                if (i + 1 >= v.array.size() || v.array[i + 1].type != RespType::kBulkString)
                     return respError("ERR syntax");
-                keys.emplace_back(v.array[i].bulk);
+                try
+                {
+                    int64_t ms = std::stoll(v.array[i + 1].bulk);
+                    if (ms < 0)
+                        return respError("ERR invalid expire time in SET");
+                    ttl_ms = ms;
+                }
+                catch (...)
+                {
+                    return respError("ERR value is not an integer or out of range");
+                }
+                i += 2;
+                continue;
             }
-            int removed = g_store.del(keys);
-            if (removed > 0)
+            else
             {
-                std::vector<std::string> parts;
-                parts.reserve(1 + keys.size());
-                parts.emplace_back("DEL");
-                for (auto &k : keys)
-                    parts.emplace_back(k);
-                if (raw)
-                    g_aof.appendRaw(*raw);
-                else
-                    g_aof.appendCommand(parts);
-                g_repl_queue.push_back(parts);
+                // unsupported option for now
+                return respError("ERR syntax");
             }
-            return respInteger(removed);
         }
-        if (cmd == "EXISTS")
+        g_store.set(v.array[1].bulk, v.array[2].bulk, ttl_ms);
+        if (!ctx.raw.empty())
+            g_aof.appendRaw(ctx.raw);
+        else
         {
-            if (v.array.size() != 2)
-                return respError("ERR wrong number of arguments for 'EXISTS'");
-            if (v.array[1].type != RespType::kBulkString)
-                return respError("ERR syntax");
-            bool ex = g_store.exists(v.array[1].bulk);
-            return respInteger(ex ? 1 : 0);
+            std::vector<std::string> parts;
+            parts.reserve(v.array.size());
+            for (const auto &e : v.array)
+                parts.push_back(e.bulk);
+            g_aof.appendCommand(parts);
         }
-        if (cmd == "EXPIRE")
+        // replicate original args
         {
-            if (v.array.size() != 3)
-                return respError("ERR wrong number of arguments for 'EXPIRE'");
-            if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString)
-                return respError("ERR syntax");
-            try
+            std::vector<std::string> parts;
+            parts.reserve(v.array.size());
+            for (const auto &e : v.array)
+                parts.push_back(e.bulk);
+            replicate(ctx, std::move(parts));
+        }
+        return respSimpleString("OK");
+    }
+
+    static std::string cmdGet(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() != 2)
+            return respError("ERR wrong number of arguments for 'GET'");
+        if (v.array[1].type != RespType::kBulkString)
+            return respError("ERR syntax");
+        auto val = g_store.get(v.array[1].bulk);
+        if (!val.has_value())
+            return respNullBulk();
+        return respBulk(*val);
+    }
+
+    static std::string cmdKeys(const RespValue &v, CommandContext &)
+    {
+        // 允许 KEYS 或 KEYS <pattern>，未带 pattern 时等价 '*'
+        std::string pattern = "*";
+        if (v.array.size() == 2)
+        {
+            if (v.array[1].type == RespType::kBulkString || v.array[1].type == RespType::kSimpleString)
             {
-                int64_t seconds = std::stoll(v.array[2].bulk);
-                bool ok = g_store.expire(v.array[1].bulk, seconds);
-                if (ok)
-                {
-                    if (raw)
-                        g_aof.appendRaw(*raw);
-                    else
-                        g_aof.appendCommand({"EXPIRE", v.array[1].bulk, std::to_string(seconds)});
-                }
-                if (ok)
-                    g_repl_queue.push_back({"EXPIRE", v.array[1].bulk, std::to_string(seconds)});
-                return respInteger(ok ? 1 : 0);
+                pattern = v.array[1].bulk;
             }
-            catch (...)
+            else
             {
-                return respError("ERR value is not an integer or out of range");
+                return respError("ERR syntax");
             }
         }
-        if (cmd == "TTL")
+        else if (v.array.size() != 1)
         {
-            if (v.array.size() != 2)
-                return respError("ERR wrong number of arguments for 'TTL'");
-            if (v.array[1].type != RespType::kBulkString)
-                return respError("ERR syntax");
-            int64_t t = g_store.ttl(v.array[1].bulk);
-            return respInteger(t);
+            return respError("ERR wrong number of arguments for 'KEYS'");
         }
-        if (cmd == "HSET")
+        GlobMatcher m(pattern);
+        std::vector<std::string> keys;
+        if (m.isLiteral())
         {
-            if (v.array.size() != 4)
-                return respError("ERR wrong number of arguments for 'HSET'");
-            if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString || v.array[3].type != RespType::kBulkString)
-                return respError("ERR syntax");
-            int created = g_store.hset(v.array[1].bulk, v.array[2].bulk, v.array[3].bulk);
-            if (raw)
-                g_aof.appendRaw(*raw);
-            else
-                g_aof.appendCommand({"HSET", v.array[1].bulk, v.array[2].bulk, v.array[3].bulk});
-            g_repl_queue.push_back({"HSET", v.array[1].bulk, v.array[2].bulk, v.array[3].bulk});
-            return respInteger(created);
+            // 不含通配符时直接查找, 无需遍历整个键空间
+            if (g_store.exists(m.literalPrefix()))
+                keys.push_back(m.literalPrefix());
         }
-        if (cmd == "HGET")
+        else
         {
-            if (v.array.size() != 3)
-                return respError("ERR wrong number of arguments for 'HGET'");
-            if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString)
-                return respError("ERR syntax");
-            auto val = g_store.hget(v.array[1].bulk, v.array[2].bulk);
-            if (!val.has_value())
-                return respNullBulk();
-            return respBulk(*val);
+            keys = g_store.listKeys(m);
         }
-        if (cmd == "HDEL")
+        std::string out = "*" + std::to_string(keys.size()) + "\r\n";
+        for (const auto &k : keys)
+            out += respBulk(k);
+        return out;
+    }
+
+    static std::string cmdScan(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() < 2)
+            return respError("ERR wrong number of arguments for 'SCAN'");
+        uint64_t cursor = 0;
+        ScanOptions opts;
+        if (auto err = parseScanArgs(v, 2, true, cursor, opts))
+            return *err;
+        std::vector<std::string> keys;
+        uint64_t next = g_store.scan(cursor, opts.count, opts.type, keys);
+        if (!opts.pattern.empty())
         {
-            if (v.array.size() < 3)
-                return respError("ERR wrong number of arguments for 'HDEL'");
-            if (v.array[1].type != RespType::kBulkString)
-                return respError("ERR syntax");
-            std::vector<std::string> fields;
-            for (size_t i = 2; i < v.array.size(); ++i)
-            {
-                if (v.array[i].type != RespType::kBulkString)
-                    return respError("ERR syntax");
-                fields.emplace_back(v.array[i].bulk);
-            }
-            int removed = g_store.hdel(v.array[1].bulk, fields);
-            if (removed > 0)
-            {
-                std::vector<std::string> parts;
-                parts.reserve(2 + fields.size());
-                parts.emplace_back("HDEL");
-                parts.emplace_back(v.array[1].bulk);
-                for (auto &f : fields)
-                    parts.emplace_back(f);
-                if (raw)
-                    g_aof.appendRaw(*raw);
-                else
-                    g_aof.appendCommand(parts);
-                g_repl_queue.push_back(parts);
-            }
-            return respInteger(removed);
+            GlobMatcher m(opts.pattern);
+            keys.erase(std::remove_if(keys.begin(), keys.end(), [&](const std::string &k)
+                                      { return !m.match(k); }),
+                       keys.end());
         }
-        if (cmd == "HEXISTS")
+        return scanReply(next, keys);
+    }
+
+    static std::string cmdHscan(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() < 3)
+            return respError("ERR wrong number of arguments for 'HSCAN'");
+        uint64_t cursor = 0;
+        ScanOptions opts;
+        if (auto err = parseScanArgs(v, 3, false, cursor, opts))
+            return *err;
+        std::vector<std::string> flat;
+        uint64_t next = g_store.hscan(v.array[1].bulk, cursor, opts.count, flat);
+        GlobMatcher m(opts.pattern.empty() ? "*" : opts.pattern);
+        std::vector<std::string> out;
+        out.reserve(flat.size());
+        for (size_t i = 0; i + 1 < flat.size(); i += 2)
         {
-            if (v.array.size() != 3)
-                return respError("ERR wrong number of arguments for 'HEXISTS'");
-            if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString)
-                return respError("ERR syntax");
-            bool ex = g_store.hexists(v.array[1].bulk, v.array[2].bulk);
-            return respInteger(ex ? 1 : 0);
+            if (!m.match(flat[i]))
+                continue;
+            out.push_back(std::move(flat[i]));
+            out.push_back(std::move(flat[i + 1]));
         }
-        if (cmd == "HGETALL")
+        return scanReply(next, out);
+    }
+
+    static std::string cmdZscan(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() < 3)
+            return respError("ERR wrong number of arguments for 'ZSCAN'");
+        uint64_t cursor = 0;
+        ScanOptions opts;
+        if (auto err = parseScanArgs(v, 3, false, cursor, opts))
+            return *err;
+        std::vector<std::pair<std::string, double>> members;
+        uint64_t next = g_store.zscan(v.array[1].bulk, cursor, opts.count, members);
+        GlobMatcher m(opts.pattern.empty() ? "*" : opts.pattern);
+        std::vector<std::string> out;
+        out.reserve(members.size() * 2);
+        for (auto &ms : members)
         {
-            if (v.array.size() != 2)
-                return respError("ERR wrong number of arguments for 'HGETALL'");
-            if (v.array[1].type != RespType::kBulkString)
-                return respError("ERR syntax");
-            auto flat = g_store.hgetallFlat(v.array[1].bulk);
-            RespValue arr;
-            arr.type = RespType::kArray;
-            arr.array.reserve(flat.size());
-            std::string out = "*" + std::to_string(flat.size()) + "\r\n";
-            for (const auto &s : flat)
-            {
-                out += respBulk(s);
-            }
-            return out;
+            if (!m.match(ms.first))
+                continue;
+            out.push_back(std::move(ms.first));
+            out.push_back(std::to_string(ms.second));
         }
-        if (cmd == "HLEN")
+        return scanReply(next, out);
+    }
+
+    static std::string cmdFlushall(const RespValue &v, CommandContext &ctx)
+    {
+        if (v.array.size() != 1)
+            return respError("ERR wrong number of arguments for 'FLUSHALL'");
+        // 清空所有数据结构
+        g_store.clear();
+        // AOF 记录
+        if (!ctx.raw.empty())
+            g_aof.appendRaw(ctx.raw);
+        else
+            g_aof.appendCommand({"FLUSHALL"});
+        // 复制广播
+        replicate(ctx, {"FLUSHALL"});
+        return respSimpleString("OK");
+    }
+
+    static std::string cmdDel(const RespValue &v, CommandContext &ctx)
+    {
+        if (v.array.size() < 2)
+            return respError("ERR wrong number of arguments for 'DEL'");
+        std::vector<std::string> keys;
+        keys.reserve(v.array.size() - 1);
+        for (size_t i = 1; i < v.array.size(); ++i)
         {
-            if (v.array.size() != 2)
-                return respError("ERR wrong number of arguments for 'HLEN'");
-            if (v.array[1].type != RespType::kBulkString)
+            if (v.array[i].type != RespType::kBulkString)
                 return respError("ERR syntax");
-            int n = g_store.hlen(v.array[1].bulk);
-            return respInteger(n);
+            keys.emplace_back(v.array[i].bulk);
         }
-        if (cmd == "ZADD")
+        int removed = g_store.del(keys);
+        if (removed > 0)
         {
-            if (v.array.size() != 4)
-                return respError("ERR wrong number of arguments for 'ZADD'");
-            if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString || v.array[3].type != RespType::kBulkString)
-                return respError("ERR syntax");
-            try
-            {
-                double sc = std::stod(v.array[2].bulk);
-                int added = g_store.zadd(v.array[1].bulk, sc, v.array[3].bulk);
-                if (raw)
-                    g_aof.appendRaw(*raw);
-                else
-                    g_aof.appendCommand({"ZADD", v.array[1].bulk, v.array[2].bulk, v.array[3].bulk});
-                g_repl_queue.push_back({"ZADD", v.array[1].bulk, v.array[2].bulk, v.array[3].bulk});
-                return respInteger(added);
-            }
-            catch (...)
-            {
-                return respError("ERR value is not a valid float");
-            }
+            std::vector<std::string> parts;
+            parts.reserve(1 + keys.size());
+            parts.emplace_back("DEL");
+            for (auto &k : keys)
+                parts.emplace_back(k);
+            if (!ctx.raw.empty())
+                g_aof.appendRaw(ctx.raw);
+            else
+                g_aof.appendCommand(parts);
+            replicate(ctx, parts);
         }
-        if (cmd == "ZREM")
+        return respInteger(removed);
+    }
+
+    static std::string cmdExists(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() != 2)
+            return respError("ERR wrong number of arguments for 'EXISTS'");
+        if (v.array[1].type != RespType::kBulkString)
+            return respError("ERR syntax");
+        bool ex = g_store.exists(v.array[1].bulk);
+        return respInteger(ex ? 1 : 0);
+    }
+
+    static std::string cmdExpire(const RespValue &v, CommandContext &ctx)
+    {
+        if (v.array.size() != 3)
+            return respError("ERR wrong number of arguments for 'EXPIRE'");
+        if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString)
+            return respError("ERR syntax");
+        try
         {
-            if (v.array.size() < 3)
-                return respError("ERR wrong number of arguments for 'ZREM'");
-            if (v.array[1].type != RespType::kBulkString)
-                return respError("ERR syntax");
-            std::vector<std::string> members;
-            for (size_t i = 2; i < v.array.size(); ++i)
-            {
-                if (v.array[i].type != RespType::kBulkString)
-                    return respError("ERR syntax");
-                members.emplace_back(v.array[i].bulk);
-            }
-            int removed = g_store.zrem(v.array[1].bulk, members);
-            if (removed > 0)
+            int64_t seconds = std::stoll(v.array[2].bulk);
+            bool ok = g_store.expire(v.array[1].bulk, seconds);
+            if (ok)
             {
-                std::vector<std::string> parts;
-                parts.reserve(2 + members.size());
-                parts.emplace_back("ZREM");
-                parts.emplace_back(v.array[1].bulk);
-                for (auto &m : members)
-                    parts.emplace_back(m);
-                if (raw)
-                    g_aof.appendRaw(*raw);
+                if (!ctx.raw.empty())
+                    g_aof.appendRaw(ctx.raw);
                 else
-                    g_aof.appendCommand(parts);
-                g_repl_queue.push_back(parts);
+                    g_aof.appendCommand({"EXPIRE", v.array[1].bulk, std::to_string(seconds)});
             }
-            return respInteger(removed);
+            if (ok)
+                replicate(ctx, {"EXPIRE", v.array[1].bulk, std::to_string(seconds)});
+            return respInteger(ok ? 1 : 0);
         }
-        if (cmd == "ZRANGE")
+        catch (...)
         {
-            if (v.array.size() != 4)
-                return respError("ERR wrong number of arguments for 'ZRANGE'");
-            if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString || v.array[3].type != RespType::kBulkString)
-                return respError("ERR syntax");
-            try
-            {
-                int64_t start = std::stoll(v.array[2].bulk);
-                int64_t stop = std::stoll(v.array[3].bulk);
-                auto members = g_store.zrange(v.array[1].bulk, start, stop);
-                std::string out = "*" + std::to_string(members.size()) + "\r\n";
-                for (const auto &m : members)
-                    out += respBulk(m);
-                return out;
-            }
-            catch (...)
-            {
-                return respError("ERR value is not an integer or out of range");
-            }
+            return respError("ERR value is not an integer or out of range");
         }
-        if (cmd == "ZSCORE")
+    }
+
+    static std::string cmdTtl(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() != 2)
+            return respError("ERR wrong number of arguments for 'TTL'");
+        if (v.array[1].type != RespType::kBulkString)
+            return respError("ERR syntax");
+        int64_t t = g_store.ttl(v.array[1].bulk);
+        return respInteger(t);
+    }
+
+    static std::string cmdHset(const RespValue &v, CommandContext &ctx)
+    {
+        if (v.array.size() != 4)
+            return respError("ERR wrong number of arguments for 'HSET'");
+        if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString || v.array[3].type != RespType::kBulkString)
+            return respError("ERR syntax");
+        int created = g_store.hset(v.array[1].bulk, v.array[2].bulk, v.array[3].bulk);
+        if (!ctx.raw.empty())
+            g_aof.appendRaw(ctx.raw);
+        else
+            g_aof.appendCommand({"HSET", v.array[1].bulk, v.array[2].bulk, v.array[3].bulk});
+        replicate(ctx, {"HSET", v.array[1].bulk, v.array[2].bulk, v.array[3].bulk});
+        return respInteger(created);
+    }
+
+    static std::string cmdHget(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() != 3)
+            return respError("ERR wrong number of arguments for 'HGET'");
+        if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString)
+            return respError("ERR syntax");
+        auto val = g_store.hget(v.array[1].bulk, v.array[2].bulk);
+        if (!val.has_value())
+            return respNullBulk();
+        return respBulk(*val);
+    }
+
+    static std::string cmdHdel(const RespValue &v, CommandContext &ctx)
+    {
+        if (v.array.size() < 3)
+            return respError("ERR wrong number of arguments for 'HDEL'");
+        if (v.array[1].type != RespType::kBulkString)
+            return respError("ERR syntax");
+        std::vector<std::string> fields;
+        for (size_t i = 2; i < v.array.size(); ++i)
         {
-            if (v.array.size() != 3)
-                return respError("ERR wrong number of arguments for 'ZSCORE'");
-            if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString)
+            if (v.array[i].type != RespType::kBulkString)
                 return respError("ERR syntax");
-            auto s = g_store.zscore(v.array[1].bulk, v.array[2].bulk);
-            if (!s.has_value())
-                return respNullBulk();
-            return respBulk(std::to_string(*s));
+            fields.emplace_back(v.array[i].bulk);
         }
-        if (cmd == "BGSAVE" || cmd == "SAVE")
+        int removed = g_store.hdel(v.array[1].bulk, fields);
+        if (removed > 0)
         {
-            if (v.array.size() != 1)
-                return respError("ERR wrong number of arguments for 'BGSAVE'");
-            std::string err;
-            if (!g_rdb.save(g_store, err))
-            {
-                return respError(std::string("ERR rdb save failed: ") + err);
-            }
-            return respSimpleString("OK");
+            std::vector<std::string> parts;
+            parts.reserve(2 + fields.size());
+            parts.emplace_back("HDEL");
+            parts.emplace_back(v.array[1].bulk);
+            for (auto &f : fields)
+                parts.emplace_back(f);
+            if (!ctx.raw.empty())
+                g_aof.appendRaw(ctx.raw);
+            else
+                g_aof.appendCommand(parts);
+            replicate(ctx, parts);
         }
-        if (cmd == "BGREWRITEAOF")
+        return respInteger(removed);
+    }
+
+    static std::string cmdHexists(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() != 3)
+            return respError("ERR wrong number of arguments for 'HEXISTS'");
+        if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString)
+            return respError("ERR syntax");
+        bool ex = g_store.hexists(v.array[1].bulk, v.array[2].bulk);
+        return respInteger(ex ? 1 : 0);
+    }
+
+    static std::string cmdHgetall(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() != 2)
+            return respError("ERR wrong number of arguments for 'HGETALL'");
+        if (v.array[1].type != RespType::kBulkString)
+            return respError("ERR syntax");
+        auto flat = g_store.hgetallFlat(v.array[1].bulk);
+        RespValue arr;
+        arr.type = RespType::kArray;
+        arr.array.reserve(flat.size());
+        std::string out = "*" + std::to_string(flat.size()) + "\r\n";
+        for (const auto &s : flat)
         {
-            if (v.array.size() != 1)
-                return respError("ERR wrong number of arguments for 'BGREWRITEAOF'");
-            std::string err;
-            if (!g_aof.isEnabled())
-                return respError("ERR AOF disabled");
-            if (!g_aof.bgRewrite(g_store, err))
-            {
-                return respError(std::string("ERR ") + err);
-            }
-            return respSimpleString("OK");
+            out += respBulk(s);
+        }
+        return out;
+    }
+
+    static std::string cmdHlen(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() != 2)
+            return respError("ERR wrong number of arguments for 'HLEN'");
+        if (v.array[1].type != RespType::kBulkString)
+            return respError("ERR syntax");
+        int n = g_store.hlen(v.array[1].bulk);
+        return respInteger(n);
+    }
+
+    static std::string cmdZadd(const RespValue &v, CommandContext &ctx)
+    {
+        if (v.array.size() != 4)
+            return respError("ERR wrong number of arguments for 'ZADD'");
+        if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString || v.array[3].type != RespType::kBulkString)
+            return respError("ERR syntax");
+        try
+        {
+            double sc = std::stod(v.array[2].bulk);
+            int added = g_store.zadd(v.array[1].bulk, sc, v.array[3].bulk);
+            if (!ctx.raw.empty())
+                g_aof.appendRaw(ctx.raw);
+            else
+                g_aof.appendCommand({"ZADD", v.array[1].bulk, v.array[2].bulk, v.array[3].bulk});
+            replicate(ctx, {"ZADD", v.array[1].bulk, v.array[2].bulk, v.array[3].bulk});
+            return respInteger(added);
         }
-        if (cmd == "CONFIG")
+        catch (...)
         {
-            if (v.array.size() < 2)
-                return respError("ERR wrong number of arguments for 'CONFIG'");
-            if (v.array[1].type != RespType::kBulkString && v.array[1].type != RespType::kSimpleString)
+            return respError("ERR value is not a valid float");
+        }
+    }
+
+    static std::string cmdZrem(const RespValue &v, CommandContext &ctx)
+    {
+        if (v.array.size() < 3)
+            return respError("ERR wrong number of arguments for 'ZREM'");
+        if (v.array[1].type != RespType::kBulkString)
+            return respError("ERR syntax");
+        std::vector<std::string> members;
+        for (size_t i = 2; i < v.array.size(); ++i)
+        {
+            if (v.array[i].type != RespType::kBulkString)
                 return respError("ERR syntax");
-            std::string sub;
-            for (char c : v.array[1].bulk)
-                sub.push_back(static_cast<char>(::toupper(c)));
-            if (sub == "GET")
+            members.emplace_back(v.array[i].bulk);
+        }
+        int removed = g_store.zrem(v.array[1].bulk, members);
+        if (removed > 0)
+        {
+            std::vector<std::string> parts;
+            parts.reserve(2 + members.size());
+            parts.emplace_back("ZREM");
+            parts.emplace_back(v.array[1].bulk);
+            for (auto &m : members)
+                parts.emplace_back(m);
+            if (!ctx.raw.empty())
+                g_aof.appendRaw(ctx.raw);
+            else
+                g_aof.appendCommand(parts);
+            replicate(ctx, parts);
+        }
+        return respInteger(removed);
+    }
+
+    static std::string cmdZrange(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() != 4)
+            return respError("ERR wrong number of arguments for 'ZRANGE'");
+        if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString || v.array[3].type != RespType::kBulkString)
+            return respError("ERR syntax");
+        try
+        {
+            int64_t start = std::stoll(v.array[2].bulk);
+            int64_t stop = std::stoll(v.array[3].bulk);
+            auto members = g_store.zrange(v.array[1].bulk, start, stop);
+            std::string out = "*" + std::to_string(members.size()) + "\r\n";
+            for (const auto &m : members)
+                out += respBulk(m);
+            return out;
+        }
+        catch (...)
+        {
+            return respError("ERR value is not an integer or out of range");
+        }
+    }
+
+    static std::string cmdZscore(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() != 3)
+            return respError("ERR wrong number of arguments for 'ZSCORE'");
+        if (v.array[1].type != RespType::kBulkString || v.array[2].type != RespType::kBulkString)
+            return respError("ERR syntax");
+        auto s = g_store.zscore(v.array[1].bulk, v.array[2].bulk);
+        if (!s.has_value())
+            return respNullBulk();
+        return respBulk(std::to_string(*s));
+    }
+
+    static std::string cmdSave(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() != 1)
+            return respError("ERR wrong number of arguments for 'BGSAVE'");
+        std::string err;
+        if (!g_rdb.save(g_store, err))
+        {
+            return respError(std::string("ERR rdb save failed: ") + err);
+        }
+        return respSimpleString("OK");
+    }
+
+    static std::string cmdBgrewriteaof(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() != 1)
+            return respError("ERR wrong number of arguments for 'BGREWRITEAOF'");
+        std::string err;
+        if (!g_aof.isEnabled())
+            return respError("ERR AOF disabled");
+        if (!g_aof.bgRewrite(g_store, err))
+        {
+            return respError(std::string("ERR ") + err);
+        }
+        return respSimpleString("OK");
+    }
+
+    static std::string cmdConfig(const RespValue &v, CommandContext &)
+    {
+        if (v.array.size() < 2)
+            return respError("ERR wrong number of arguments for 'CONFIG'");
+        if (v.array[1].type != RespType::kBulkString && v.array[1].type != RespType::kSimpleString)
+            return respError("ERR syntax");
+        std::string sub;
+        for (char c : v.array[1].bulk)
+            sub.push_back(static_cast<char>(::toupper(c)));
+        if (sub == "GET")
+        {
+            // 允许 CONFIG GET 与 CONFIG GET <pattern>（未提供时默认 "*")
+            std::string pattern = "*";
+            if (v.array.size() >= 3)
             {
-                // 允许 CONFIG GET 与 CONFIG GET <pattern>（未提供时默认 "*")
-                std::string pattern = "*";
-                if (v.array.size() >= 3)
-                {
-                    if (v.array[2].type != RespType::kBulkString && v.array[2].type != RespType::kSimpleString)
-                        return respError("ERR wrong number of arguments for 'CONFIG GET'");
-                    pattern = v.array[2].bulk;
-                }
-                else if (v.array.size() != 2)
-                {
+                if (v.array[2].type != RespType::kBulkString && v.array[2].type != RespType::kSimpleString)
                     return respError("ERR wrong number of arguments for 'CONFIG GET'");
-                }
-                auto match = [&](const std::string &k) -> bool
-                {
-                    if (pattern == "*")
-                        return true;
-                    return pattern == k;
-                };
-                std::vector<std::pair<std::string, std::string>> kvs;
-                // minimal set to satisfy tooling
-                kvs.emplace_back("appendonly", g_aof.isEnabled() ? "yes" : "no");
-                std::string appendfsync;
-                switch (g_aof.mode())
-                {
-                case AofMode::kNo:
-                    appendfsync = "no";
-                    break;
-                case AofMode::kEverySec:
-                    appendfsync = "everysec";
-                    break;
-                case AofMode::kAlways:
-                    appendfsync = "always";
-                    break;
-                }
-                kvs.emplace_back("appendfsync", appendfsync);
-                kvs.emplace_back("dir", "./data");
-                kvs.emplace_back("dbfilename", "dump.rdb");
-                kvs.emplace_back("save", "");
-                kvs.emplace_back("timeout", "0");
-                kvs.emplace_back("databases", "16");
-                kvs.emplace_back("maxmemory", "0");
-                std::string body;
-                size_t elems = 0;
-                if (pattern == "*")
-                {
-                    for (auto &p : kvs)
-                    {
-                        body += respBulk(p.first);
-                        body += respBulk(p.second);
-                        elems += 2;
-                    }
-                }
-                else
-                {
-                    for (auto &p : kvs)
-                    {
-                        if (match(p.first))
-                        {
-                            body += respBulk(p.first);
-                            body += respBulk(p.second);
-                            elems += 2;
-                        }
-                    }
-                }
-                return "*" + std::to_string(elems) + "\r\n" + body;
+                pattern = v.array[2].bulk;
             }
-            else if (sub == "RESETSTAT")
+            else if (v.array.size() != 2)
             {
-                if (v.array.size() != 2)
-                    return respError("ERR wrong number of arguments for 'CONFIG RESETSTAT'");
-                return respSimpleString("OK");
+                return respError("ERR wrong number of arguments for 'CONFIG GET'");
             }
-            else
+            GlobMatcher match(pattern);
+            std::vector<std::pair<std::string, std::string>> kvs;
+            // minimal set to satisfy tooling
+            kvs.emplace_back("appendonly", g_aof.isEnabled() ? "yes" : "no");
+            std::string appendfsync;
+            switch (g_aof.mode())
             {
-                return respError("ERR unsupported CONFIG subcommand");
+            case AofMode::kNo:
+                appendfsync = "no";
+                break;
+            case AofMode::kEverySec:
+                appendfsync = "everysec";
+                break;
+            case AofMode::kAlways:
+                appendfsync = "always";
+                break;
+            }
+            kvs.emplace_back("appendfsync", appendfsync);
+            kvs.emplace_back("dir", "./data");
+            kvs.emplace_back("dbfilename", "dump.rdb");
+            kvs.emplace_back("save", "");
+            kvs.emplace_back("timeout", "0");
+            kvs.emplace_back("databases", "16");
+            kvs.emplace_back("maxmemory", "0");
+            kvs.emplace_back("repl-backlog-size", std::to_string(g_config->repl.backlog_size));
+            std::string body;
+            size_t elems = 0;
+            for (auto &p : kvs)
+            {
+                if (match.match(p.first))
+                {
+                    body += respBulk(p.first);
+                    body += respBulk(p.second);
+                    elems += 2;
+                }
             }
+            return "*" + std::to_string(elems) + "\r\n" + body;
         }
-        if (cmd == "INFO")
+        else if (sub == "RESETSTAT")
         {
-            // INFO [section] -> ignore section for now
-            std::string info;
-            info.reserve(512);
-            info += "# Server\r\nredis_version:0.1.0\r\nrole:master\r\n";
-            info += "# Clients\r\nconnected_clients:0\r\n";
-            info += "# Stats\r\ntotal_connections_received:0\r\ntotal_commands_processed:0\r\ninstantaneous_ops_per_sec:0\r\n";
-            info += "# Persistence\r\naof_enabled:";
-            info += (g_aof.isEnabled() ? "1" : "0");
-            info += "\r\naof_rewrite_in_progress:0\r\nrdb_bgsave_in_progress:0\r\n";
-            info += "# Replication\r\nconnected_slaves:0\r\nmaster_repl_offset:" + std::to_string(g_repl_offset) + "\r\n";
-            return respBulk(info);
+            if (v.array.size() != 2)
+                return respError("ERR wrong number of arguments for 'CONFIG RESETSTAT'");
+            return respSimpleString("OK");
+        }
+        else
+        {
+            return respError("ERR unsupported CONFIG subcommand");
         }
-        return respError("ERR unknown command");
+    }
+
+    static std::string cmdInfo(const RespValue &, CommandContext &)
+    {
+        // INFO [section] -> ignore section for now
+        std::string info;
+        info.reserve(512);
+        info += "# Server\r\nredis_version:0.1.0\r\nrole:master\r\n";
+        info += "# Clients\r\nconnected_clients:0\r\n";
+        info += "# Memory\r\nallocator_frag_pct:" + std::to_string(heapFragmentationPct()) + "\r\n";
+        info += "# Stats\r\ntotal_connections_received:0\r\ntotal_commands_processed:0\r\ninstantaneous_ops_per_sec:0\r\n";
+        info += "active_defrag_running:" + std::string(g_defrag_running ? "1" : "0") + "\r\n";
+        info += "active_defrag_hits:" + std::to_string(g_store.defragHits()) + "\r\n";
+        info += "active_defrag_misses:" + std::to_string(g_store.defragMisses()) + "\r\n";
+        info += "# Persistence\r\naof_enabled:";
+        info += (g_aof.isEnabled() ? "1" : "0");
+        info += "\r\naof_rewrite_in_progress:0\r\nrdb_bgsave_in_progress:0\r\n";
+        info += "# Replication\r\nconnected_slaves:0\r\nmaster_replid:" + g_replid + "\r\n";
+        info += "master_repl_offset:" + std::to_string(g_repl_offset) + "\r\n";
+        info += "repl_backlog_active:" + std::string(g_backlog.active() ? "1" : "0") + "\r\n";
+        info += "repl_backlog_size:" + std::to_string(g_backlog.active() ? g_backlog.capacity() : g_config->repl.backlog_size) + "\r\n";
+        info += "repl_backlog_first_byte_offset:" + std::to_string(g_backlog.startOffset()) + "\r\n";
+        info += "repl_backlog_histlen:" + std::to_string(g_backlog.size()) + "\r\n";
+        return respBulk(info);
+    }
+
+    // @brief 注册所有命令, 在事件循环和复制线程启动之前调用
+    static void registerCommands()
+    {
+        static const Command kCommands[] = {
+            {"PING", cmdPing, -1, 0},
+            {"ECHO", cmdEcho, 2, 0},
+            {"SET", cmdSet, -3, kCmdWrite},
+            {"GET", cmdGet, 2, kCmdReadOnly},
+            {"KEYS", cmdKeys, -1, kCmdReadOnly},
+            {"SCAN", cmdScan, -2, kCmdReadOnly},
+            {"HSCAN", cmdHscan, -3, kCmdReadOnly},
+            {"ZSCAN", cmdZscan, -3, kCmdReadOnly},
+            {"FLUSHALL", cmdFlushall, 1, kCmdWrite},
+            {"DEL", cmdDel, -2, kCmdWrite},
+            {"EXISTS", cmdExists, 2, kCmdReadOnly},
+            {"EXPIRE", cmdExpire, 3, kCmdWrite},
+            {"TTL", cmdTtl, 2, kCmdReadOnly},
+            {"HSET", cmdHset, 4, kCmdWrite},
+            {"HGET", cmdHget, 3, kCmdReadOnly},
+            {"HDEL", cmdHdel, -3, kCmdWrite},
+            {"HEXISTS", cmdHexists, 3, kCmdReadOnly},
+            {"HGETALL", cmdHgetall, 2, kCmdReadOnly},
+            {"HLEN", cmdHlen, 2, kCmdReadOnly},
+            {"ZADD", cmdZadd, 4, kCmdWrite},
+            {"ZREM", cmdZrem, -3, kCmdWrite},
+            {"ZRANGE", cmdZrange, 4, kCmdReadOnly},
+            {"ZSCORE", cmdZscore, 3, kCmdReadOnly},
+            {"SAVE", cmdSave, 1, kCmdAdmin},
+            {"BGSAVE", cmdSave, 1, kCmdAdmin},
+            {"BGREWRITEAOF", cmdBgrewriteaof, 1, kCmdAdmin},
+            {"CONFIG", cmdConfig, -2, kCmdAdmin},
+            {"INFO", cmdInfo, -1, 0},
+        };
+        for (const auto &cmd : kCommands)
+            g_commands.add(cmd);
     }
 
     int Server::loop()
@@ -878,7 +1230,7 @@ namespace tiny_redis
                         int one = 1;
                         setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
                         add_epoll(epoll_fd_, cfd, EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLHUP);
-                        conns.emplace(cfd, Conn{cfd, std::string(), std::vector<std::string>{}, 0, 0, RespParser{}, false});
+                        conns.emplace(cfd, Conn{cfd, std::string(), std::vector<OutChunk>{}, 0, 0, RespParser{}, false});
                     }
                     continue;
                 }
@@ -900,6 +1252,59 @@ namespace tiny_redis
                             break;
                     }
                     g_store.expireScanStep(64);
+                    if (config_.defrag.enabled)
+                    {
+                        // 每秒(5个tick)采样一次分配器碎片率, 超过阈值才进行整理; 无法采样时一直整理
+                        static int defrag_tick = 0;
+                        if (defrag_tick++ % 5 == 0)
+                        {
+                            int pct = heapFragmentationPct();
+                            g_defrag_running = pct < 0 || pct >= config_.defrag.threshold_pct;
+                        }
+                        if (g_defrag_running)
+                            g_store.defragStep(config_.defrag.cycle_us);
+                    }
+                    continue;
+                }
+
+                if (fd == g_transfer_event_fd)
+                {
+                    uint64_t cnt;
+                    while (::read(g_transfer_event_fd, &cnt, sizeof(cnt)) > 0)
+                    {
+                    }
+                    std::vector<std::pair<int, bool>> done;
+                    {
+                        std::lock_guard<std::mutex> lk(g_transfer_mu);
+                        done.swap(g_transfer_done);
+                    }
+                    for (const auto &d : done)
+                    {
+                        auto th = g_transfer_threads.find(d.first);
+                        if (th != g_transfer_threads.end())
+                        {
+                            th->second.join();
+                            g_transfer_threads.erase(th);
+                        }
+                        auto cit = conns.find(d.first);
+                        if (cit == conns.end())
+                            continue;
+                        // 快照发送完毕, 开始补发传输期间积累的命令流
+                        Conn &tc = cit->second;
+                        tc.repl_transfer = false;
+                        uint32_t tev = d.second ? 0u : static_cast<uint32_t>(EPOLLRDHUP);
+                        if (d.second)
+                            try_flush_now(tc.fd, tc, tev);
+                        if (tev & EPOLLRDHUP)
+                        {
+                            epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, tc.fd, nullptr);
+                            close(tc.fd);
+                            conns.erase(cit);
+                            continue;
+                        }
+                        if (has_pending(tc))
+                            mod_epoll(epoll_fd_, tc.fd, EPOLLIN | EPOLLET | EPOLLOUT | EPOLLRDHUP | EPOLLHUP);
+                    }
                     continue;
                 }
 
@@ -908,6 +1313,10 @@ namespace tiny_redis
                     continue;
                 Conn &c = it->second;
 
+                // 快照传输期间socket归后台线程使用, 连接出错时由线程发现并上报, 这里不能关闭fd
+                if (c.repl_transfer && ((ev & EPOLLHUP) || (ev & EPOLLERR)))
+                    continue;
+
                 // Immediate close only on EPOLLHUP or EPOLLERR; defer EPOLLRDHUP until after flushing replies
                 if ((ev & EPOLLHUP) || (ev & EPOLLERR))
                 {
@@ -964,36 +1373,53 @@ namespace tiny_redis
                                     cmd.push_back(static_cast<char>(::toupper(ch)));
                                 if (cmd == "PSYNC")
                                 {
-                                    // PSYNC <offset>
-                                    if (v.array.size() == 2 && v.array[1].type == RespType::kBulkString)
+                                    // PSYNC <replid> <offset>: 复制ID一致且积压缓冲区中仍有offset之后的数据时, 只补发缺失的部分
+                                    if (v.array.size() == 3 && v.array[1].type == RespType::kBulkString &&
+                                        v.array[2].type == RespType::kBulkString)
                                     {
-                                        int64_t want = 0;
+                                        int64_t want = -1;
                                         try
                                         {
-                                            want = std::stoll(v.array[1].bulk);
+                                            want = std::stoll(v.array[2].bulk);
                                         }
                                         catch (...)
                                         {
                                             want = -1;
                                         }
-                                        // hit backlog?
-                                        if (want >= g_backlog_start_offset && want <= g_repl_offset)
+                                        if (v.array[1].bulk == g_replid && g_backlog.contains(want))
                                         {
-                                            size_t start = static_cast<size_t>(want - g_backlog_start_offset);
-                                            if (start < g_repl_backlog.size())
-                                            {
-                                                c.is_replica = true;
-                                                std::string off = "+OFFSET " + std::to_string(g_repl_offset) + "\r\n";
-                                                enqueue_out(c, off);
-                                                enqueue_out(c, g_repl_backlog.substr(start));
-                                                continue;
-                                            }
+                                            c.is_replica = true;
+                                            enqueue_out(c, "+CONTINUE " + g_replid + "\r\n");
+                                            sendBacklogFrom(c, want);
+                                            try_flush_now(fd, c, ev);
+                                            if (has_pending(c))
+                                                mod_epoll(epoll_fd_, fd, EPOLLIN | EPOLLET | EPOLLOUT | EPOLLRDHUP | EPOLLHUP);
+                                            continue;
                                         }
                                     }
                                     // fallback to full resync using SYNC path below
                                 }
-                                if (cmd == "SYNC")
+                                if (cmd == "SYNC" || cmd == "PSYNC")
                                 {
+                                    ensureBacklog();
+                                    // PSYNC在快照之前回复+FULLRESYNC <replid> <offset>; 旧的SYNC则在快照之后发送+OFFSET
+                                    const bool psync = cmd == "PSYNC";
+                                    std::string fullresync = "+FULLRESYNC " + g_replid + " " + std::to_string(g_repl_offset) + "\r\n";
+                                    if (config_.repl.diskless_sync)
+                                    {
+                                        // 无盘复制: 快照由子进程直接写到socket, 之后的命令流从当前偏移量开始
+                                        try_flush_now(fd, c, ev);
+                                        if (!startDisklessTransfer(fd, psync ? fullresync : std::string()))
+                                        {
+                                            enqueue_out(c, respError("ERR sync fork failed"));
+                                            continue;
+                                        }
+                                        c.is_replica = true;
+                                        c.repl_transfer = true;
+                                        if (!psync)
+                                            enqueue_out(c, "+OFFSET " + std::to_string(g_repl_offset) + "\r\n");
+                                        continue;
+                                    }
                                     // produce RDB snapshot bytes
                                     std::string err;
                                     // Save to temp path and read back
@@ -1019,23 +1445,33 @@ namespace tiny_redis
                                         else
                                         {
                                             std::string content;
-                                            content.resize(0);
-                                            char rb[8192];
+                                            std::error_code fec;
+                                            auto fsize = std::filesystem::file_size(path, fec);
+                                            if (!fec)
+                                                content.reserve(static_cast<size_t>(fsize));
+                                            char rb[65536];
                                             size_t m;
                                             while ((m = fread(rb, 1, sizeof(rb), f)) > 0)
                                                 content.append(rb, m);
                                             fclose(f);
-                                            enqueue_out(c, respBulk(content));
+                                            if (psync)
+                                                enqueue_out(c, std::move(fullresync));
+                                            // 分块入队, 避免再拷贝一次整个快照拼成bulk string
+                                            enqueue_out(c, "$" + std::to_string(content.size()) + "\r\n");
+                                            enqueue_out(c, std::move(content));
+                                            enqueue_out(c, "\r\n");
                                             c.is_replica = true;
                                             // 发送当前 offset（简单实现：用 RESP 简单字符串）
-                                            std::string off = "+OFFSET " + std::to_string(g_repl_offset) + "\r\n";
-                                            enqueue_out(c, std::move(off));
+                                            if (!psync)
+                                                enqueue_out(c, "+OFFSET " + std::to_string(g_repl_offset) + "\r\n");
                                         }
                                     }
                                     continue; // do not pass to normal handler
                                 }
                             }
-                            enqueue_out(c, handle_command(v, &raw));
+                            CommandContext ctx;
+                            ctx.raw = raw;
+                            enqueue_out(c, dispatchCommand(v, ctx));
                             // try immediate flush so pipe client can receive replies without waiting
                             try_flush_now(fd, c, ev);
                         }
@@ -1043,22 +1479,22 @@ namespace tiny_redis
                     // Broadcast any replication commands to replicas
                     if (!g_repl_queue.empty())
                     {
+                        // 本轮产生的写命令只序列化一次, 写入backlog一次, 所有从节点引用同一个缓冲区
+                        // 复制偏移量只统计命令流本身的字节数, 与backlog中保存的内容一一对应
+                        std::string stream;
+                        for (const auto &parts : g_repl_queue)
+                            stream += toRespArray(parts);
+                        auto buf = std::make_shared<const std::string>(std::move(stream));
+                        g_repl_offset += static_cast<int64_t>(buf->size());
+                        g_backlog.append(buf->data(), buf->size());
                         for (auto &kv : conns)
                         {
                             Conn &rc = kv.second;
                             if (!rc.is_replica)
                                 continue;
-                            for (const auto &parts : g_repl_queue)
-                            {
-                                std::string cmd = toRespArray(parts);
-                                int64_t next_off = g_repl_offset + static_cast<int64_t>(cmd.size());
-                                std::string off = "+OFFSET " + std::to_string(next_off) + "\r\n";
-                                appendToBacklog(off);
-                                appendToBacklog(cmd);
-                                g_repl_offset = next_off;
-                                enqueue_out(rc, std::move(off));
-                                enqueue_out(rc, std::move(cmd));
-                            }
+                            // 正在从积压缓冲区续传的从节点会在续传中读到这段数据
+                            if (rc.backlog_off < 0)
+                                enqueue_shared(rc, buf);
                             if (has_pending(rc))
                             {
                                 mod_epoll(epoll_fd_, rc.fd, EPOLLIN | EPOLLET | EPOLLOUT | EPOLLRDHUP | EPOLLHUP);
@@ -1071,7 +1507,7 @@ namespace tiny_redis
                         mod_epoll(epoll_fd_, fd, EPOLLIN | EPOLLET | EPOLLOUT | EPOLLRDHUP | EPOLLHUP);
                     }
                     // If peer half-closed and nothing pending, close now
-                    if ((ev & EPOLLRDHUP) && !has_pending(c))
+                    if ((ev & EPOLLRDHUP) && !has_pending(c) && !c.repl_transfer)
                     {
                         epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
                         close(fd);
@@ -1080,72 +1516,9 @@ namespace tiny_redis
                     }
                 }
 
-                if (ev & EPOLLOUT)
+                if ((ev & EPOLLOUT) && !c.repl_transfer)
                 {
-                    while (has_pending(c))
-                    {
-                        const size_t max_iov = 64;
-                        struct iovec iov[max_iov];
-                        int iovcnt = 0;
-                        size_t idx = c.out_iov_idx;
-                        size_t off = c.out_offset;
-                        while (idx < c.out_chunks.size() && iovcnt < (int)max_iov)
-                        {
-                            const std::string &s = c.out_chunks[idx];
-                            const char *base = s.data();
-                            size_t len = s.size();
-                            if (off >= len)
-                            {
-                                ++idx;
-                                off = 0;
-                                continue;
-                            }
-                            iov[iovcnt].iov_base = (void *)(base + off);
-                            iov[iovcnt].iov_len = len - off;
-                            ++iovcnt;
-                            ++idx;
-                            off = 0;
-                        }
-                        if (iovcnt == 0)
-                            break;
-                        ssize_t w = ::writev(fd, iov, iovcnt);
-                        if (w > 0)
-                        {
-                            size_t rem = (size_t)w;
-                            while (rem > 0 && c.out_iov_idx < c.out_chunks.size())
-                            {
-                                std::string &s = c.out_chunks[c.out_iov_idx];
-                                size_t avail = s.size() - c.out_offset;
-                                if (rem < avail)
-                                {
-                                    c.out_offset += rem;
-                                    rem = 0;
-                                }
-                                else
-                                {
-                                    rem -= avail;
-                                    c.out_offset = 0;
-                                    ++c.out_iov_idx;
-                                }
-                            }
-                            if (c.out_iov_idx >= c.out_chunks.size())
-                            {
-                                c.out_chunks.clear();
-                                c.out_iov_idx = 0;
-                                c.out_offset = 0;
-                            }
-                        }
-                        else if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
-                        {
-                            break;
-                        }
-                        else
-                        {
-                            std::perror("writev");
-                            ev |= EPOLLRDHUP;
-                            break;
-                        }
-                    }
+                    try_flush_now(fd, c, ev);
                     if (!has_pending(c))
                     {
                         mod_epoll(epoll_fd_, fd, EPOLLIN | EPOLLRDHUP | EPOLLHUP);
@@ -1164,6 +1537,9 @@ namespace tiny_redis
 
     int Server::run()
     {
+        g_config = &config_;
+        g_replid = randomHexId();
+        registerCommands();
         if (setupListen() < 0)
             return -1;
         if (setupEpoll() < 0)
@@ -54,11 +54,11 @@ namespace tiny_redis {
         // 当前节点的level
         int lvl = randomLevel();
         if(lvl > level_) {
-            // 需要更新最高level
-            level_ = lvl;
+            // 需要更新最高level, 新增的层级上前驱都是哨兵节点
             for(int i=level_; i<lvl; ++i) {
                 update[static_cast<size_t>(i)] = head_;
             }
+            level_ = lvl;
         }
         auto *node = new SkiplistNode(lvl, score, member);
         for(int i=0;i<lvl;++i) {
@@ -86,7 +86,7 @@ namespace tiny_redis {
         }
 
         x = x->forward[0];
-        if(x != nullptr || abs(x->score-score)>kDelta || x->member!=member) {
+        if(x == nullptr || abs(x->score-score)>kDelta || x->member!=member) {
             // 没有找到要删除的节点
             return false;
         }
@@ -152,4 +152,51 @@ namespace tiny_redis {
         }
     }
 
+    size_t Skiplist::defrag(DefragCursor &cur, size_t limit, size_t &misses) {
+        size_t hits = 0;
+        // prev[i]: 第i层上最后一个被访问过的节点, 即当前节点在第i层的前驱
+        std::vector<SkiplistNode *> prev(static_cast<size_t>(kMaxLevel), head_);
+        SkiplistNode *x = head_;
+        if(cur.active) {
+            // 定位到第一个不小于(score, member)的节点, 上次停下的节点可能已经被删除
+            for(int i = level_ - 1; i >= 0; --i) {
+                while(x->forward[i] != nullptr &&
+                      comparedLess(x->forward[i]->score, x->forward[i]->member, cur.score, cur.member)) {
+                    x = x->forward[i];
+                }
+                prev[i] = x;
+            }
+        }
+        x = x->forward[0];
+        for(size_t n = 0; x != nullptr && n < limit; ++n) {
+            SkiplistNode *nxt = x->forward[0];
+            size_t h = x->forward.size();
+            if(shouldRelocate(x->member)) {
+                // 拷贝构造的member只会按实际长度分配内存
+                auto *y = new SkiplistNode(static_cast<int>(h), x->score, x->member);
+                for(size_t i=0;i<h;++i) {
+                    y->forward[i] = x->forward[i];
+                    prev[i]->forward[i] = y;
+                }
+                delete x;
+                x = y;
+                ++hits;
+            } else {
+                ++misses;
+            }
+            for(size_t i=0;i<h;++i) {
+                prev[i] = x;
+            }
+            x = nxt;
+        }
+        if(x == nullptr) {
+            cur.reset();
+        } else {
+            cur.active = true;
+            cur.score = x->score;
+            cur.member = x->member;
+        }
+        return hits;
+    }
+
 } // namespace tiny_redis